@@ -169,22 +169,26 @@ JNIEXPORT void JNICALL Java_com_umasagashi_umacapture_ScreenCaptureService_updat
         jint row_stride,
         jint scaled_width,
         jint scaled_height) {
-    static cv::Mat buffer_mat;
-
     log_trace("");
 
     auto raw_mat = uma::android::java_vm.wrapAsMat(frame, width, height, row_stride);
 
-    const cv::Size scaled_size = {scaled_width, scaled_height};
-    if (buffer_mat.size() != scaled_size) {
-        buffer_mat = cv::Mat(scaled_size, CV_8UC4);
-    }
-    cv::resize(raw_mat, buffer_mat, scaled_size, 0, 0, cv::INTER_LINEAR);
-
-    auto mat = cv::Mat(scaled_size, CV_8UC3);
-    cv::cvtColor(buffer_mat, mat, cv::COLOR_RGBA2BGR);
-    uma::app::NativeApi::instance().updateFrame(mat,
-                                                uma::chrono_util::timestamp());  // TODO: take timestamp in android.
+    // The java buffer is valid only during this call, so it is converted right away, into an image the frame can keep.
+    // Resizing and converting to BGR in a single pass costs about as much as the resize alone.
+    auto &api = uma::app::NativeApi::instance();
+    const cv::Size frame_size = api.frameSizeFor({scaled_width, scaled_height});
+    cv::Mat buffer_mat = uma::FramePool::instance().lease(frame_size, CV_8UC3);
+    uma::ingest_kernels::resizeToBGR(raw_mat.data,
+                                     raw_mat.step,
+                                     raw_mat.cols,
+                                     raw_mat.rows,
+                                     uma::RGBA8888,
+                                     buffer_mat.data,
+                                     buffer_mat.step,
+                                     buffer_mat.cols,
+                                     buffer_mat.rows);
+
+    api.updateFrame(buffer_mat, raw_mat.size(), uma::chrono_util::timestamp());  // TODO: take timestamp in android.
 }
 
 JNIEXPORT void JNICALL
@@ -202,6 +202,7 @@ final platformConfigLoader = FutureProvider<JsonMap>((ref) async {
         .loadString('assets/config/chara_detail/recognizer.json')
         .then((text) => config["chara_detail"]["recognizer"] = jsonDecode(text)),
     rootBundle.loadString('assets/config/platform.json').then((text) => config["platform"] = jsonDecode(text)),
+    rootBundle.loadString('assets/config/event_loop.json').then((text) => config["event_loop"] = jsonDecode(text)),
   ]);
 
   return config;
@@ -299,6 +300,9 @@ class PlatformController {
             .read(latestScreenshotProvider.notifier)
             .update((_) => ScreenshotResult(FilePath(data['path']), data['result']));
         break;
+      case 'onMetricsReported':
+        logger.d(data['metrics']);
+        break;
       case 'onFrameSizeReported':
         final size = Size(data['size']['width'].toDouble(), data['size']['height'].toDouble());
         _ref.read(capturingFrameSizeProvider.notifier).update((_) => size);
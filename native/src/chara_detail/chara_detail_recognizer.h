@@ -1,5 +1,9 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
@@ -740,6 +744,10 @@ public:
     void recognize(const std::string &id, bool isUpdateMode) {
         vlog_debug(id, isUpdateMode);
 
+        // Records of different ids are recognized in parallel, but the files of a record are written by one at a time.
+        const auto record_mutex = recordMutex(id);
+        std::lock_guard<std::mutex> record_lock(*record_mutex);
+
         const auto &record_dir = record_root_dir / id;
 
         const auto &skill_frame = Frame::open(record_dir / "skill.png");
@@ -810,6 +818,20 @@ public:
     }
 
 private:
+    // The mutex lives while any recognition of the record holds it.
+    std::shared_ptr<std::mutex> recordMutex(const std::string &id) {
+        std::lock_guard<std::mutex> lock(record_mutexes_mutex);
+        for (auto it = record_mutexes.begin(); it != record_mutexes.end();) {
+            it = it->second.expired() ? record_mutexes.erase(it) : std::next(it);
+        }
+        auto record_mutex = record_mutexes[id].lock();
+        if (!record_mutex) {
+            record_mutex = std::make_shared<std::mutex>();
+            record_mutexes[id] = record_mutex;
+        }
+        return record_mutex;
+    }
+
     const std::string trainer_id;
     const std::filesystem::path record_root_dir;
     const std::filesystem::path module_root_dir;
@@ -825,6 +847,9 @@ private:
 
     const event_util::Listener<std::string> on_update_requested;
     const event_util::Sender<std::string> on_update_completed;
+
+    std::mutex record_mutexes_mutex;
+    std::unordered_map<std::string, std::weak_ptr<std::mutex>> record_mutexes;
 };
 
 }  // namespace uma::chara_detail
@@ -7,11 +7,12 @@
 #include "cv/scene_context.h"
 #include "util/event_util.h"
 #include "util/json_util.h"
+#include "util/misc.h"
 #include "util/stds.h"
 
 namespace uma::chara_detail {
 
-using TabCondition = condition::ParallelCondition<Frame, rule::LogicalOr>;
+using TabCondition = condition::DetailedCondition<Frame>;
 
 enum TabPage {
     SkillPage = 0,
@@ -31,22 +32,38 @@ public:
     CharaDetailSceneContext(
         const std::shared_ptr<condition::Condition<Frame>> &child,
         const event_util::Sender<> &on_scene_begin,
-        const event_util::Sender<Frame, SceneInfo> &on_scene_updated,
+        const event_util::Sender<event_util::Shared<Frame>, SceneInfo> &on_scene_updated,
         const event_util::Sender<> &on_scene_end,
-        const chrono_util::time_unit &scene_end_timeout)
+        const chrono_util::time_unit &scene_end_timeout,
+        const event_util::TimerService &timers,
+        const event_util::Connection<event_util::TimerId> &on_scene_end_timeout,
+        const chrono_util::Clock &clock)
         : child(child)
         , tab_condition(dynamic_cast<const TabCondition *>(child->findByTag("tab_condition")))
         , on_scene_begin(on_scene_begin)
         , on_scene_updated(on_scene_updated)
         , on_scene_end(on_scene_end)
-        , scene_end_timeout(scene_end_timeout) {
+        , scene_end_timeout(scene_end_timeout)
+        , timers(timers)
+        , on_scene_end_timeout(on_scene_end_timeout)
+        , clock(clock) {
         if (tab_condition == nullptr) {
             throw std::runtime_error("tab_condition not found");
         }
+        // Delivered on the same runner as update(), so the timer state needs no lock.
+        this->on_scene_end_timeout->listen([this](event_util::TimerId id) {
+            if (scene_end_timer == id) {
+                scene_end_timer = std::nullopt;
+                on_scene_end->send();
+            }
+        });
     }
 
-    void update(const Frame &input) override {
-        child->update(input);
+    void update(const event_util::Shared<Frame> &input) override {
+        clock->advance(input->timestamp());
+        checkSceneEndDeadline();
+
+        child->update(*input, *clock);
         const auto tab_index = getActiveTabIndex();
         met_ = child->met() && tab_index.has_value();
 
@@ -69,20 +86,49 @@ public:
 
     [[nodiscard]] bool met() const override { return met_; }
 
+    // While the scene is met, the scraper needs every frame to tell that the screen is stationary.
+    // A pending scene end on the frame clock needs the timestamps of the next frames too.
+    [[nodiscard]] bool settled() const override { return !met_ && !scene_end_deadline && child->settled(); }
+
+    // No frame follows to reach the deadline, so a pending scene end is fired now, as the timer would have done.
+    void flush() override {
+        if (scene_end_deadline) {
+            scene_end_deadline = std::nullopt;
+            on_scene_end->send();
+        }
+    }
+
 private:
+    // Returns true if the scene had not ended yet. An expiry that is already queued is ignored after this.
     bool cancelSceneEndTimer() {
-        if (scene_end_timer) {
-            scene_end_timer->cancel();
-            const auto expired = scene_end_timer->hasExpired();
-            scene_end_timer = nullptr;
-            return expired.has_value() && !expired.value();
+        if (scene_end_deadline) {
+            scene_end_deadline = std::nullopt;
+            return true;
+        }
+        if (!scene_end_timer) {
+            return false;
         }
-        return false;
+        timers->cancel(scene_end_timer.value());
+        scene_end_timer = std::nullopt;
+        return true;
     }
 
     void startSceneEndTimer() {
         cancelSceneEndTimer();
-        scene_end_timer = std::make_unique<thread_util::Timer>(scene_end_timeout, [this]() { on_scene_end->send(); });
+        if (clock->realTime()) {
+            scene_end_timer = timers->schedule(scene_end_timeout, on_scene_end_timeout);
+        } else {
+            // The timer service runs on the wall clock, so the deadline is checked against the next frames instead.
+            scene_end_deadline = clock->now() + scene_end_timeout.count();
+        }
+    }
+
+    // Ends the scene before the frame is evaluated, as the timer would have done while waiting for the frame.
+    void checkSceneEndDeadline() {
+        if (scene_end_deadline && clock->now() >= scene_end_deadline.value()) {
+            scene_end_deadline = std::nullopt;
+            on_scene_end->send();
+        }
     }
 
     [[nodiscard]] std::optional<int> getActiveTabIndex() const {
@@ -96,14 +142,18 @@ private:
     }
 
     const std::shared_ptr<condition::Condition<Frame>> child;
-    const condition::ParallelCondition<Frame, rule::LogicalOr> *tab_condition;
+    const TabCondition *tab_condition;
     const event_util::Sender<> on_scene_begin;
-    const event_util::Sender<Frame, SceneInfo> on_scene_updated;
+    const event_util::Sender<event_util::Shared<Frame>, SceneInfo> on_scene_updated;
     const event_util::Sender<> on_scene_end;
-
-    std::unique_ptr<thread_util::Timer> scene_end_timer;
     const chrono_util::time_unit scene_end_timeout;
 
+    const event_util::TimerService timers;
+    const event_util::Connection<event_util::TimerId> on_scene_end_timeout;
+    std::optional<event_util::TimerId> scene_end_timer;
+    const chrono_util::Clock clock;
+    std::optional<uint64_t> scene_end_deadline;
+
     bool previous_condition = false;
     bool met_ = false;
 };
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Weverything"
@@ -13,8 +18,11 @@
 
 #include "chara_detail/chara_detail_config.h"
 #include "chara_detail/chara_detail_scene_context.h"
+#include "chara_detail/chara_detail_scraping_session.h"
 #include "core/native_api.h"
 #include "util/logger_util.h"
+#include "util/metrics_util.h"
+#include "util/thread_util.h"
 
 namespace uma::chara_detail {
 
@@ -48,11 +56,39 @@ inline bool readyAfterUpdate(T &subject, const Frame &frame) {
     return subject.ready();
 }
 
+// Rows [begin, end) of a frame.
+struct RowBand {
+    int begin;
+    int end;
+
+    [[nodiscard]] inline bool contains(double y) const { return begin <= y && y < end; }
+    [[nodiscard]] inline int size() const { return std::max(0, end - begin); }
+
+    [[nodiscard]] inline RowBand intersect(const RowBand &other) const {
+        return {std::max(begin, other.begin), std::min(end, other.end)};
+    }
+
+    [[nodiscard]] inline RowBand expanded(int margin) const { return {begin - margin, end + margin}; }
+    [[nodiscard]] inline RowBand shifted(int offset) const { return {begin + offset, end + offset}; }
+};
+
+/**
+ * Key points of a frame at one scale, detected a stripe of rows at a time as estimations need them.
+ * A frame is matched twice, with the frame before it on its upper rows, and with the frame after it on its lower rows,
+ * so each time, only the stripes that were not needed before are detected.
+ */
+struct KeyPointStripes {
+    std::vector<bool> detected;
+    std::vector<cv::KeyPoint> key_points;  // In pixels of the frame, whatever the scale they were detected at.
+    cv::Mat descriptors;
+};
+
 struct FrameDescriptor {
     Frame frame;
     double scroll_bar_length = 0.0;
-    std::vector<cv::KeyPoint> key_points;
-    cv::Mat descriptors;
+    KeyPointStripes coarse_key_points;
+    KeyPointStripes key_points;
+    cv::Mat row_profile;
 
     [[nodiscard]] bool empty() const { return frame.empty(); }
 };
@@ -61,7 +97,9 @@ class ScrollBarOffsetEstimator {
 public:
     ScrollBarOffsetEstimator(const Range<Color> &scroll_bar_bg_color_range, const Line<double> &scroll_bar_scan_line)
         : scroll_bar_bg_color_range(scroll_bar_bg_color_range)
-        , scroll_bar_scan_line(scroll_bar_scan_line) {}
+        , scroll_bar_scan_line(scroll_bar_scan_line)
+        , upper_sample_plan(scroll_bar_scan_line)
+        , lower_sample_plan(scroll_bar_scan_line.reversed()) {}
 
     [[nodiscard]] bool hasScrollbar(const Frame &frame) const { return findScrollbar(frame).has_value(); }
 
@@ -108,8 +146,8 @@ private:
     }
 
     [[nodiscard]] std::optional<std::pair<double, double>> scanMargin(const Frame &frame) const {
-        const auto &upper_margin = frame.lengthIn(scroll_bar_bg_color_range, scroll_bar_scan_line);
-        const auto &lower_margin = frame.lengthIn(scroll_bar_bg_color_range, scroll_bar_scan_line.reversed());
+        const auto &upper_margin = frame.lengthIn(scroll_bar_bg_color_range, upper_sample_plan.planFor(frame));
+        const auto &lower_margin = frame.lengthIn(scroll_bar_bg_color_range, lower_sample_plan.planFor(frame));
         if (!upper_margin || upper_margin.value() == 1. || !lower_margin || lower_margin.value() == 1.) {
             return std::nullopt;  // Bar not found.
         }
@@ -118,8 +156,17 @@ private:
 
     const Range<Color> scroll_bar_bg_color_range;
     const Line<double> scroll_bar_scan_line;
+    const SamplePlanCache upper_sample_plan;
+    const SamplePlanCache lower_sample_plan;
 };
 
+/**
+ * Estimates the vertical offset between two frames of the scroll area, within the threshold around the guess of the
+ * scroll bar. The scroll area only ever moves vertically, so the row profiles of the frames are correlated first,
+ * which costs a fraction of a millisecond. Only when the correlation is not confident, like on a blank area or on
+ * rows that repeat within the threshold, are the features of the frames matched instead.
+ * Features are detected only in the rows that can overlap, and kept in the descriptors for the next estimation.
+ */
 class ImageOffsetEstimator {
 public:
     struct ImageOffsetEstimatorConfig {
@@ -134,6 +181,18 @@ public:
         int table_number = 3;
         int key_size = 12;
         int probe_level = 1;
+        bool use_projection = true;
+        int projection_columns = 8;  // Each row is averaged in this many columns, and per channel.
+        double minimum_correlation = 0.97;
+        double minimum_correlation_margin = 0.02;  // From the best other peak, which may be a repeated row.
+        double minimum_overlap_ratio = 0.25;
+        double minimum_profile_deviation = 2.0;  // Below this, the area is almost blank.
+        double prediction_window = 4.;
+        double coarse_scale = 0.5;  // One disables the coarse detection.
+        int stripe_height = 64;
+        int stripe_padding = 32;  // Key points closer than this to the edge of the image are not detected.
+        int refine_margin = 16;
+        double refine_threshold = 4.;
     };
 
     explicit ImageOffsetEstimator(const ImageOffsetEstimatorConfig &config)
@@ -141,6 +200,18 @@ public:
         , horizontal_threshold(config.horizontal_threshold)
         , minimum_key_points(config.minimum_key_points)
         , vertical_threshold(config.vertical_threshold)
+        , use_projection(config.use_projection)
+        , projection_columns(config.projection_columns)
+        , minimum_correlation(config.minimum_correlation)
+        , minimum_correlation_margin(config.minimum_correlation_margin)
+        , minimum_overlap_ratio(config.minimum_overlap_ratio)
+        , minimum_profile_deviation(config.minimum_profile_deviation)
+        , prediction_window(config.prediction_window)
+        , coarse_scale(config.coarse_scale)
+        , stripe_height(config.stripe_height)
+        , stripe_padding(config.stripe_padding)
+        , refine_margin(config.refine_margin)
+        , refine_threshold(config.refine_threshold)
         , detector(cv::AKAZE::create(
               cv::AKAZE::DESCRIPTOR_MLDB_UPRIGHT,
               0,
@@ -156,13 +227,97 @@ public:
         : ImageOffsetEstimator(ImageOffsetEstimatorConfig()) {}
 
     [[nodiscard]] std::optional<double> estimate(FrameDescriptor &from, FrameDescriptor &to, double guess) const {
-        detectKeyPoints(from);
-        detectKeyPoints(to);
+        if (use_projection) {
+            const auto offset = estimateByProjection(from, to, guess);
+            if (offset) {
+                return offset;
+            }
+        }
+        return estimateByFeatures(from, to, guess);
+    }
 
-        std::vector<std::vector<cv::DMatch>> matches;
-        matcher->knnMatch(from.descriptors, to.descriptors, matches, 2);
+    // Null if the correlation is not confident.
+    [[nodiscard]] std::optional<double> estimateByProjection(
+        FrameDescriptor &from, FrameDescriptor &to, double guess) const {
+        return correlationPeak(from, to, {guess - vertical_threshold, guess + vertical_threshold}, true);
+    }
+
+    // Only the few rows around the prediction are correlated. Within them, a repeated row can not be mistaken for
+    // the offset, so the peak only needs to be confident and inside them. The guess of the scroll bar is never wrong
+    // by more than the threshold, so neither may the prediction be.
+    [[nodiscard]] std::optional<double> verifyPrediction(
+        FrameDescriptor &from, FrameDescriptor &to, double prediction, double guess) const {
+        if (std::abs(prediction - guess) > vertical_threshold) {
+            return std::nullopt;
+        }
+        return correlationPeak(from, to, {prediction - prediction_window, prediction + prediction_window}, false);
+    }
 
+    // Only the rows that can overlap are detected, first at a coarse scale, and then at full scale only around the
+    // matches found at the coarse scale.
+    [[nodiscard]] std::optional<double> estimateByFeatures(
+        FrameDescriptor &from, FrameDescriptor &to, double guess) const {
         const Range<double> valid_range = {guess - vertical_threshold, guess + vertical_threshold};
+
+        // Row y of the latter is row y + offset of the former.
+        const int minimum_offset = static_cast<int>(std::floor(valid_range.min()));
+        const int maximum_offset = static_cast<int>(std::ceil(valid_range.max()));
+        const RowBand from_band = RowBand{minimum_offset, to.frame.height() + maximum_offset}.intersect(
+            {0, from.frame.height()});
+        const RowBand to_band = RowBand{-maximum_offset, from.frame.height() - minimum_offset}.intersect(
+            {0, to.frame.height()});
+
+        if (coarse_scale >= 1.0) {
+            const auto match = matchBands(from, to, false, from_band, to_band, valid_range);
+            return match ? std::make_optional(match->offset) : std::nullopt;
+        }
+
+        const auto coarse = matchBands(from, to, true, from_band, to_band, valid_range);
+        if (!coarse) {
+            return std::nullopt;
+        }
+
+        const auto coarse_offset = static_cast<int>(std::lround(coarse->offset));
+        const auto refined_from_band = coarse->inliers.expanded(refine_margin).intersect(from_band);
+        const auto refined_to_band =
+            refined_from_band.shifted(-coarse_offset).expanded(refine_margin).intersect(to_band);
+        const Range<double> refined_range = {coarse->offset - refine_threshold, coarse->offset + refine_threshold};
+        const auto refined = matchBands(from, to, false, refined_from_band, refined_to_band, refined_range);
+        return refined ? std::make_optional(refined->offset) : std::nullopt;
+    }
+
+private:
+    struct BandFeatures {
+        std::vector<cv::Point2f> points;
+        cv::Mat descriptors;
+    };
+
+    struct BandMatch {
+        double offset;
+        RowBand inliers;  // Rows of the former frame.
+    };
+
+    [[nodiscard]] std::optional<BandMatch> matchBands(
+        FrameDescriptor &from,
+        FrameDescriptor &to,
+        bool coarse,
+        const RowBand &from_band,
+        const RowBand &to_band,
+        const Range<double> &valid_range) const {
+        const double scale = coarse ? coarse_scale : 1.0;
+        auto &from_stripes = coarse ? from.coarse_key_points : from.key_points;
+        auto &to_stripes = coarse ? to.coarse_key_points : to.key_points;
+        detectStripes(from.frame, from_stripes, scale, from_band);
+        detectStripes(to.frame, to_stripes, scale, to_band);
+        const auto from_features = select(from_stripes, from_band);
+        const auto to_features = select(to_stripes, to_band);
+        if (from_features.points.size() < minimum_key_points || to_features.points.size() < minimum_key_points) {
+            return std::nullopt;
+        }
+
+        std::vector<std::vector<cv::DMatch>> matches;
+        matcher->knnMatch(from_features.descriptors, to_features.descriptors, matches, 2);
+
         std::vector<cv::Point2f> valid_key_points_of_from;
         std::vector<cv::Point2f> valid_key_points_of_to;
         for (const auto &knn_match : matches) {
@@ -171,8 +326,8 @@ public:
                 continue;
             }
 
-            const auto &key_point_of_from = from.key_points[knn_match[0].queryIdx].pt;
-            const auto &key_point_of_to = to.key_points[knn_match[0].trainIdx].pt;
+            const auto &key_point_of_from = from_features.points[knn_match[0].queryIdx];
+            const auto &key_point_of_to = to_features.points[knn_match[0].trainIdx];
 
             // The guess is not precise, but never wrong, matches that are far from it can be discarded.
             if (!valid_range.contains(key_point_of_from.y - key_point_of_to.y)) {
@@ -188,8 +343,13 @@ public:
             return std::nullopt;
         }
 
+        // Coarse key points are only as precise as their scale.
         cv::Mat masks;
-        cv::Mat result = cv::findHomography(valid_key_points_of_to, valid_key_points_of_from, masks, cv::RANSAC, 3);
+        cv::Mat result =
+            cv::findHomography(valid_key_points_of_to, valid_key_points_of_from, masks, cv::RANSAC, 3 / scale);
+        if (result.empty()) {
+            return std::nullopt;
+        }
         std::vector<double> matrix((double *) result.datastart, (double *) result.dataend);
         const Point<double> offset = {matrix[2], matrix[5]};
 
@@ -197,20 +357,173 @@ public:
         matrix[2] = 0.0;
         matrix[5] = 0.0;
         const std::vector<double> eye{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
-        if (!closeEnough(matrix, eye, 0.1) || std::abs(offset.x()) > horizontal_threshold) {
+        if (!closeEnough(matrix, eye, 0.1) || std::abs(offset.x()) > horizontal_threshold / scale) {
             return std::nullopt;
         }
 
-        return offset.y();
+        RowBand inliers = {from_band.end, from_band.begin};
+        for (int i = 0; i < masks.rows; i++) {
+            if (masks.at<uchar>(i)) {
+                const auto y = static_cast<int>(valid_key_points_of_from[i].y);
+                inliers = {std::min(inliers.begin, y), std::max(inliers.end, y + 1)};
+            }
+        }
+        return BandMatch{offset.y(), inliers};
     }
 
-private:
-    [[nodiscard]] void detectKeyPoints(FrameDescriptor &descriptor) const {
-        if (!descriptor.key_points.empty()) {
+    // Detects the stripes of the band that were not detected yet. Adjacent ones are detected at once.
+    void detectStripes(const Frame &frame, KeyPointStripes &stripes, double scale, const RowBand &band) const {
+        const int stripe_count = (frame.height() + stripe_height - 1) / stripe_height;
+        stripes.detected.resize(stripe_count, false);
+
+        const int last = std::min(stripe_count, (band.end + stripe_height - 1) / stripe_height);
+        for (int stripe = std::max(0, band.begin / stripe_height); stripe < last;) {
+            if (stripes.detected[stripe]) {
+                stripe++;
+                continue;
+            }
+            int end = stripe;
+            while (end < last && !stripes.detected[end]) {
+                stripes.detected[end++] = true;
+            }
+            detectRows(frame, stripes, scale, {stripe * stripe_height, std::min(frame.height(), end * stripe_height)});
+            stripe = end;
+        }
+    }
+
+    void detectRows(const Frame &frame, KeyPointStripes &stripes, double scale, const RowBand &rows) const {
+        // Padded, so that the key points near the edges of the rows are detected as in the whole frame.
+        const auto padded = rows.expanded(stripe_padding).intersect({0, frame.height()});
+        cv::Mat image = frame.data().rowRange(padded.begin, padded.end);
+        if (scale < 1.0) {
+            cv::Mat scaled;
+            cv::resize(image, scaled, {}, scale, scale, cv::INTER_AREA);
+            image = scaled;
+        }
+
+        std::vector<cv::KeyPoint> key_points;
+        cv::Mat descriptors;
+        detector->detectAndCompute(image, cv::noArray(), key_points, descriptors);
+        for (int i = 0; i < key_points.size(); i++) {
+            auto key_point = key_points[i];
+            key_point.pt.x = static_cast<float>((key_point.pt.x + 0.5) / scale - 0.5);
+            key_point.pt.y = static_cast<float>((key_point.pt.y + 0.5) / scale - 0.5 + padded.begin);
+            key_point.size = static_cast<float>(key_point.size / scale);
+            if (!rows.contains(key_point.pt.y)) {
+                continue;  // Belongs to the padding, which is another stripe.
+            }
+            stripes.key_points.push_back(key_point);
+            stripes.descriptors.push_back(descriptors.row(i));
+        }
+    }
+
+    [[nodiscard]] static BandFeatures select(const KeyPointStripes &stripes, const RowBand &band) {
+        BandFeatures features;
+        for (int i = 0; i < stripes.key_points.size(); i++) {
+            if (band.contains(stripes.key_points[i].pt.y)) {
+                features.points.push_back(stripes.key_points[i].pt);
+                features.descriptors.push_back(stripes.descriptors.row(i));
+            }
+        }
+        return features;
+    }
+
+    // Peak of the correlation of the row profiles over the offsets in the range, where row y of the latter is row
+    // y + offset of the former. If unique, no other peak in the range may come close to it.
+    [[nodiscard]] std::optional<double> correlationPeak(
+        FrameDescriptor &from, FrameDescriptor &to, const Range<double> &offsets, bool unique) const {
+        computeRowProfile(from);
+        computeRowProfile(to);
+        const cv::Mat &a = from.row_profile;
+        const cv::Mat &b = to.row_profile;
+
+        const int minimum_offset = static_cast<int>(std::ceil(offsets.min()));
+        const int maximum_offset = static_cast<int>(std::floor(offsets.max()));
+        const int minimum_overlap = std::max(2, static_cast<int>(b.rows * minimum_overlap_ratio));
+        std::vector<double> correlations;
+        for (int offset = minimum_offset; offset <= maximum_offset; offset++) {
+            correlations.push_back(correlationAt(a, b, offset, minimum_overlap).value_or(-1.0));
+        }
+
+        const auto best = std::max_element(correlations.begin(), correlations.end());
+        if (best == correlations.end() || *best < minimum_correlation) {
+            return std::nullopt;
+        }
+        const auto best_index = static_cast<int>(best - correlations.begin());
+
+        const auto size = static_cast<int>(correlations.size());
+        if (unique) {
+            // The slopes of the best peak are skipped, so that only another peak makes the result ambiguous.
+            int left = best_index;
+            while (left > 0 && correlations[left - 1] <= correlations[left]) {
+                left--;
+            }
+            int right = best_index;
+            while (right < size - 1 && correlations[right + 1] <= correlations[right]) {
+                right++;
+            }
+            for (int i = 0; i < size; i++) {
+                if ((i < left || right < i) && correlations[i] > *best - minimum_correlation_margin) {
+                    return std::nullopt;
+                }
+            }
+        } else if (best_index == 0 || best_index == size - 1) {
+            return std::nullopt;  // The peak may be outside the range.
+        }
+
+        // Sub-pixel position of the peak, from the parabola through it and its neighbours.
+        double refinement = 0.0;
+        if (0 < best_index && best_index < size - 1) {
+            const double previous = correlations[best_index - 1];
+            const double next = correlations[best_index + 1];
+            const double curvature = previous - 2.0 * *best + next;
+            if (curvature < 0.0) {
+                refinement = std::clamp(0.5 * (previous - next) / curvature, -0.5, 0.5);
+            }
+        }
+        return minimum_offset + best_index + refinement;
+    }
+
+    void computeRowProfile(FrameDescriptor &descriptor) const {
+        if (!descriptor.row_profile.empty()) {
             return;
         }
-        detector->detectAndCompute(
-            descriptor.frame.data(), cv::noArray(), descriptor.key_points, descriptor.descriptors);
+        const cv::Mat &image = descriptor.frame.data();
+        cv::Mat averaged;
+        cv::resize(image, averaged, {projection_columns, image.rows}, 0, 0, cv::INTER_AREA);
+        averaged.convertTo(descriptor.row_profile, CV_32F);
+        descriptor.row_profile = descriptor.row_profile.reshape(1);
+    }
+
+    // Pearson correlation of the overlapping rows. Null if they overlap too little, or either side is almost blank.
+    [[nodiscard]] std::optional<double> correlationAt(
+        const cv::Mat &a, const cv::Mat &b, int offset, int minimum_overlap) const {
+        const int begin = std::max(0, -offset);
+        const int end = std::min(b.rows, a.rows - offset);
+        if (end - begin < minimum_overlap) {
+            return std::nullopt;
+        }
+
+        double sum_a = 0.0, sum_b = 0.0, sum_aa = 0.0, sum_bb = 0.0, sum_ab = 0.0;
+        for (int y = begin; y < end; y++) {
+            const auto *row_a = a.ptr<float>(y + offset);
+            const auto *row_b = b.ptr<float>(y);
+            for (int x = 0; x < b.cols; x++) {
+                sum_a += row_a[x];
+                sum_b += row_b[x];
+                sum_aa += row_a[x] * row_a[x];
+                sum_bb += row_b[x] * row_b[x];
+                sum_ab += row_a[x] * row_b[x];
+            }
+        }
+        const double n = static_cast<double>(end - begin) * b.cols;
+        const double variance_a = sum_aa - sum_a * sum_a / n;
+        const double variance_b = sum_bb - sum_b * sum_b / n;
+        const double minimum_variance = minimum_profile_deviation * minimum_profile_deviation * n;
+        if (variance_a < minimum_variance || variance_b < minimum_variance) {
+            return std::nullopt;
+        }
+        return (sum_ab - sum_a * sum_b / n) / std::sqrt(variance_a * variance_b);
     }
 
     const cv::Ptr<cv::Feature2D> detector;
@@ -219,6 +532,18 @@ private:
     const double horizontal_threshold;
     const int minimum_key_points;
     const double vertical_threshold;
+    const bool use_projection;
+    const int projection_columns;
+    const double minimum_correlation;
+    const double minimum_correlation_margin;
+    const double minimum_overlap_ratio;
+    const double minimum_profile_deviation;
+    const double prediction_window;
+    const double coarse_scale;
+    const int stripe_height;
+    const int stripe_padding;
+    const int refine_margin;
+    const double refine_threshold;
 };
 
 class ScrollAreaOffsetEstimator {
@@ -240,24 +565,224 @@ public:
         return image_offset_estimator.estimate(from, to, guess.value());
     }
 
+    // Null unless the images agree with the prediction. The guess of the scroll bar is too coarse to be verified
+    // this way, since a repeated row near it would pass.
+    [[nodiscard]] std::optional<double> verify(FrameDescriptor &from, FrameDescriptor &to, double prediction) const {
+        const auto guess = scroll_bar_offset_estimator.estimate(from, to);
+        if (!guess) {
+            return std::nullopt;
+        }
+        return image_offset_estimator.verifyPrediction(from, to, prediction, guess.value());
+    }
+
 private:
     const ScrollBarOffsetEstimator scroll_bar_offset_estimator;
     const ImageOffsetEstimator image_offset_estimator;
 };
 
+/**
+ * Constant velocity of the scroll, from the offsets measured so far. The velocity is smoothed, since the timestamps
+ * of the frames jitter, and forgotten when an offset could not be measured, since the user may have let go.
+ */
+class ScrollMotionModel {
+public:
+    explicit ScrollMotionModel(double gain)
+        : gain(gain) {}
+
+    [[nodiscard]] std::optional<double> predict(uint64 elapsed) const {
+        if (!velocity || elapsed == 0) {
+            return std::nullopt;
+        }
+        return velocity.value() * static_cast<double>(elapsed);
+    }
+
+    void update(double offset, uint64 elapsed) {
+        if (elapsed == 0) {
+            return;
+        }
+        const double measured = offset / static_cast<double>(elapsed);
+        velocity = velocity ? velocity.value() + gain * (measured - velocity.value()) : measured;
+    }
+
+    void reset() { velocity = std::nullopt; }
+
+private:
+    const double gain;
+    std::optional<double> velocity;  // Pixels per millisecond.
+};
+
+struct ScrollTrackingCounters {
+    // Offsets that only needed the rows around the prediction to be compared.
+    const std::shared_ptr<metrics_util::Counter> predicted = std::make_shared<metrics_util::Counter>();
+    // Offsets that were estimated in the whole range of the scroll bar.
+    const std::shared_ptr<metrics_util::Counter> estimated = std::make_shared<metrics_util::Counter>();
+};
+
+/**
+ * Estimates the offsets of the scroll area on its own thread, while the scraper goes on with the next frames.
+ * Each frame is estimated against the last one that scrolled far enough, as the scraper did in place, and the fragments
+ * are handed back in the order of the frames. Frames wait here instead of being dropped, however far behind this is,
+ * so that no offset spans more than the frames in between. Under load, the queues before the scraper drop them instead.
+ * One worker serves every page of a scraper. Each page has its own track, since its fragments may still be estimated
+ * after the user switched to another page.
+ */
+class ScrollOffsetWorker : public thread_util::ThreadBase {
+public:
+    struct Fragment {
+        Frame frame;
+        int offset_pixels;
+        std::optional<double> position;  // Of the frame before, as the scroll bar tells it.
+    };
+
+    // The scrolling of a page, from its first valid frame until it is ended. From here, the estimator is used only by
+    // the worker.
+    struct Track {
+        Track(
+            const ScrollAreaOffsetEstimator &offset_estimator,
+            const FrameDescriptor &initial_descriptor,
+            double minimum_scroll)
+            : offset_estimator(offset_estimator)
+            , minimum_scroll(minimum_scroll)
+            , previous_descriptor(initial_descriptor) {}
+
+        const ScrollAreaOffsetEstimator offset_estimator;
+        const double minimum_scroll;
+
+        // Guarded by the mutex of the worker.
+        std::deque<Fragment> fragments;
+        bool ended = false;
+
+        // Only the worker thread touches these.
+        FrameDescriptor previous_descriptor;
+        ScrollMotionModel motion_model = ScrollMotionModel(0.5);
+    };
+
+    ScrollOffsetWorker(size_t capacity, const ScrollTrackingCounters &counters)
+        : capacity(capacity)
+        , counters(counters) {}
+
+    // Drops the frames of the track still waiting, and the fragments not polled yet.
+    void end(const std::shared_ptr<Track> &track) {
+        std::lock_guard<std::mutex> lock(mutex);
+        track->ended = true;
+        track->fragments.clear();
+        pending.erase(
+            std::remove_if(pending.begin(), pending.end(), [&](const auto &item) { return item.first == track; }),
+            pending.end());
+        condition.notify_all();
+    }
+
+    // Blocks while as many frames as the capacity wait for their estimation.
+    void push(const std::shared_ptr<Track> &track, const Frame &frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return pending.size() < capacity || !isRunning(); });
+        if (isRunning() && !track->ended) {
+            pending.emplace_back(track, frame);
+            condition.notify_all();
+        }
+    }
+
+    // Blocks until every frame pushed so far is estimated.
+    void waitUntilIdle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return (pending.empty() && !estimating) || !isRunning(); });
+    }
+
+    // Null if the next fragment of the track is not estimated yet.
+    std::optional<Fragment> poll(const std::shared_ptr<Track> &track) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (track->fragments.empty()) {
+            return std::nullopt;
+        }
+        auto fragment = std::move(track->fragments.front());
+        track->fragments.pop_front();
+        return fragment;
+    }
+
+protected:
+    void run() override {
+        while (true) {
+            std::shared_ptr<Track> track;
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return !pending.empty() || !isRunning(); });
+                if (!isRunning()) {
+                    return;
+                }
+                std::tie(track, frame) = pending.front();
+                pending.pop_front();
+                estimating = true;
+                condition.notify_all();
+            }
+
+            FrameDescriptor current_descriptor = {frame};
+            const auto offset = estimate(*track, current_descriptor);
+            std::optional<Fragment> fragment;
+            if (offset.value_or(-1.0) > track->minimum_scroll) {
+                const auto position = track->offset_estimator.position(track->previous_descriptor);
+                fragment = Fragment{frame, static_cast<int>(std::lround(offset.value())), position};
+                track->previous_descriptor = current_descriptor;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fragment && !track->ended) {
+                track->fragments.push_back(std::move(fragment.value()));
+            }
+            estimating = false;
+            condition.notify_all();
+        }
+    }
+
+    void interrupt() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+    }
+
+private:
+    // While the user scrolls steadily, the offset is predicted from the motion, and verified by a few rows.
+    // Otherwise, as before the motion is known, it is estimated as without a prediction.
+    std::optional<double> estimate(Track &track, FrameDescriptor &current_descriptor) {
+        auto &previous_descriptor = track.previous_descriptor;
+        const auto elapsed = current_descriptor.frame.timestamp() - previous_descriptor.frame.timestamp();
+        const auto prediction = track.motion_model.predict(elapsed);
+        auto offset = prediction
+                          ? track.offset_estimator.verify(previous_descriptor, current_descriptor, prediction.value())
+                          : std::nullopt;
+        if (offset) {
+            counters.predicted->increment();
+        } else {
+            offset = track.offset_estimator.estimate(previous_descriptor, current_descriptor);
+            counters.estimated->increment();
+        }
+
+        if (offset) {
+            track.motion_model.update(offset.value(), elapsed);
+        } else {
+            track.motion_model.reset();
+        }
+        return offset;
+    }
+
+    const size_t capacity;
+    const ScrollTrackingCounters counters;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::pair<std::shared_ptr<Track>, Frame>> pending;
+    bool estimating = false;
+};
+
 class PageScrapingBox {
 public:
-    PageScrapingBox(
-        const std::vector<scraper_config::ScanParameter> &scan_parameters, const std::filesystem::path &image_dir)
-        : scan_parameters(scan_parameters)
-        , image_dir(image_dir) {
+    explicit PageScrapingBox(const std::vector<scraper_config::ScanParameter> &scan_parameters)
+        : scan_parameters(scan_parameters) {
         current_scan = this->scan_parameters.begin();
-        app::NativeApi::instance().mkdir(image_dir);
     }
 
     void addTabButton(const Frame &frame) {
         assert_(!tab_button_ready);
-        frame.save(image_dir / path_config.tab_button.filename());
+        page_.tab_button = frame.detachedCopy();
         tab_button_ready = true;
     }
 
@@ -285,41 +810,41 @@ public:
             }
             const Rect<double> rect = {scaled_top_left, {1., scaled_y}};
             if (!rect.empty()) {
-                saveIncremental(frame.view(rect));
+                addFragment(frame.view(rect));
             }
             return;
         }
-        saveIncremental(frame.view({scaled_top_left, anchor.mapFromFrame(frame.rect().bottomRight())}));
+        addFragment(frame.view({scaled_top_left, anchor.mapFromFrame(frame.rect().bottomRight())}));
     }
 
     void addScrollArea(const Frame &frame) {
-        assert_(image_count == 0);
+        assert_(page_.scroll_area.empty());
         addScrollArea(frame, frame.height());
     }
 
     void setScrollArea(const Frame &frame) {
-        assert_(image_count == 0);
-        saveIncremental(frame);
+        assert_(page_.scroll_area.empty());
+        addFragment(frame);
         current_scan = scan_parameters.end();
     }
 
     [[nodiscard]] inline bool scrollAreaReady() const {
-        return image_count > 0 && current_scan == scan_parameters.end();
+        return !page_.scroll_area.empty() && current_scan == scan_parameters.end();
     }
 
     [[nodiscard]] inline bool ready() const { return tab_button_ready && scrollAreaReady(); }
 
+    [[nodiscard]] const ScrapedPage &page() const { return page_; }
+
 private:
-    void saveIncremental(const Frame &frame) {
-        frame.save(image_dir / path_config.scroll_area.withNumber(image_count++, 5).filename());
-    }
+    // Fragments are views of frames copied from the pool, so each is copied out to release the frame.
+    void addFragment(const Frame &frame) { page_.scroll_area.push_back(frame.detachedCopy()); }
 
-    const std::filesystem::path image_dir;
     const std::vector<scraper_config::ScanParameter> scan_parameters;
 
     std::vector<scraper_config::ScanParameter>::const_iterator current_scan;
     int current_length_pixels = 0;
-    int image_count = 0;
+    ScrapedPage page_;
 
     bool tab_button_ready = false;
 };
@@ -330,11 +855,11 @@ public:
         const std::vector<scraper_config::ScanParameter> &skill_scans,
         const std::vector<scraper_config::ScanParameter> &factor_scans,
         const std::vector<scraper_config::ScanParameter> &campaign_scans,
-        const std::filesystem::path &image_dir)
-        : skill_box_(std::make_shared<PageScrapingBox>(skill_scans, image_dir / path_config.skill.stem()))
-        , factor_box_(std::make_shared<PageScrapingBox>(factor_scans, image_dir / path_config.factor.stem()))
-        , campaign_box_(std::make_shared<PageScrapingBox>(campaign_scans, image_dir / path_config.campaign.stem()))
-        , base_path(image_dir / path_config.base.filename()) {}
+        const std::string &id)
+        : skill_box_(std::make_shared<PageScrapingBox>(skill_scans))
+        , factor_box_(std::make_shared<PageScrapingBox>(factor_scans))
+        , campaign_box_(std::make_shared<PageScrapingBox>(campaign_scans))
+        , id(id) {}
 
     [[nodiscard]] std::shared_ptr<PageScrapingBox> skill_box() const { return skill_box_; }
     [[nodiscard]] std::shared_ptr<PageScrapingBox> factor_box() const { return factor_box_; }
@@ -342,7 +867,7 @@ public:
 
     void addBase(const Frame &frame) {
         assert_(!base_ready);
-        frame.save(base_path);
+        base = frame.detachedCopy();
         base_ready = true;
     }
 
@@ -350,8 +875,16 @@ public:
         return base_ready && skill_box_->ready() && factor_box_->ready() && campaign_box_->ready();
     }
 
+    // Frames are shared with the boxes, not copied.
+    [[nodiscard]] event_util::Shared<ScrapingSession> session() const {
+        assert_(ready());
+        return event_util::makeShared<ScrapingSession>(
+            ScrapingSession{id, base, skill_box_->page(), factor_box_->page(), campaign_box_->page()});
+    }
+
 private:
-    const std::filesystem::path base_path;
+    const std::string id;
+    Frame base;
 
     std::shared_ptr<PageScrapingBox> skill_box_;
     std::shared_ptr<PageScrapingBox> factor_box_;
@@ -361,45 +894,61 @@ private:
 
 class StationaryFrameCatcher {
 public:
-    StationaryFrameCatcher(uint64 stationary_time, int minimum_color, uint64 stationary_color, const Rect<double> &rect)
+    StationaryFrameCatcher(
+        uint64 stationary_time,
+        int minimum_color,
+        uint64 stationary_color,
+        const Rect<double> &rect,
+        const chrono_util::Clock &clock)
         : stationary_time(stationary_time)
         , minimum_color(minimum_color)
         , stationary_color(stationary_color)
-        , target_rect(rect) {}
+        , target_rect(rect)
+        , clock(clock) {}
 
     void update(const Frame &frame) {
+        const auto now = clock->now();
         if (previous_frame.empty()) {
             previous_frame = frame;
+            previous_timestamp = now;
             return;
         }
 
-        if (previous_frame.pixelDifference(frame, target_rect, minimum_color) < stationary_color) {
+        // Only whether the difference is below the threshold matters, so a moving frame stops the sum early.
+        const auto &pixels = target_rect.layout().empty() ? frame.rect() : target_rect.pixelsFor(frame);
+        if (previous_frame.pixelDifference(frame, pixels, minimum_color, stationary_color) < stationary_color) {
             if (!first_timestamp) {
-                first_timestamp = previous_frame.timestamp();
+                first_timestamp = previous_timestamp;
             }
         } else {
             first_timestamp = std::nullopt;
         }
         previous_frame = frame;
+        previous_timestamp = now;
     }
 
     [[nodiscard]] inline bool ready() const {
-        return first_timestamp.has_value() && (previous_frame.timestamp() - first_timestamp.value()) > stationary_time;
+        return first_timestamp.has_value() && (previous_timestamp - first_timestamp.value()) > stationary_time;
     }
 
     [[nodiscard]] inline Frame fullSizeFrame() const { return previous_frame; }
 
     [[nodiscard]] inline Frame croppedFrame() const {
-        return target_rect.empty() ? previous_frame : previous_frame.view(target_rect);
+        if (target_rect.layout().empty()) {
+            return previous_frame;
+        }
+        return previous_frame.view(target_rect.pixelsFor(previous_frame));
     }
 
 private:
-    const Rect<double> target_rect;
+    const LayoutCache<Rect<double>> target_rect;
     const uint64 stationary_time;
     const int minimum_color;
     const uint64 stationary_color;
+    const chrono_util::Clock clock;
 
     Frame previous_frame;
+    uint64 previous_timestamp = 0;
     std::optional<uint64> first_timestamp;
 };
 
@@ -408,6 +957,9 @@ public:
     virtual ~ScrapingInterpreter() = default;
     virtual void update(const Frame &frame) = 0;
     [[nodiscard]] virtual bool ready() const = 0;
+
+    // Takes what was done off the scraper thread since the last frame. With wait, waits for the frames given so far.
+    virtual void collect(bool wait) {}
 };
 
 enum ReadyState {
@@ -447,6 +999,7 @@ public:
         const StationaryFrameCatcher &stationary_catcher,
         double initial_scroll_threshold,
         double minimum_scroll_threshold,
+        const std::shared_ptr<ScrollOffsetWorker> &offset_worker,
         const event_util::Sender<> &on_scroll_ready,
         const event_util::Sender<double> &on_scroll_updated)
         : offset_estimator(offset_estimator)
@@ -454,9 +1007,16 @@ public:
         , scraping_box(scraping_box)
         , initial_scroll(initial_scroll_threshold)
         , minimum_scroll(minimum_scroll_threshold)
+        , offset_worker(offset_worker)
         , on_scroll_ready(on_scroll_ready)
         , on_scroll_updated(on_scroll_updated) {}
 
+    ~ScrollableScrapingInterpreter() override {
+        if (scroll_track) {
+            offset_worker->end(scroll_track);
+        }
+    }
+
     void update(const Frame &frame) override {
         assert_(state == Updatable);
 
@@ -469,6 +1029,29 @@ public:
 
     [[nodiscard]] inline bool ready() const override { return state == Ready; }
 
+    // The fragments estimated meanwhile are added here, even while the frames are of another page.
+    void collect(bool wait) override {
+        if (state != Updatable || !scroll_track) {
+            return;
+        }
+        if (wait) {
+            offset_worker->waitUntilIdle();
+        }
+
+        while (const auto fragment = offset_worker->poll(scroll_track)) {
+            if (fragment->position) {
+                on_scroll_updated->send(fragment->position.value());
+            }
+
+            scraping_box->addScrollArea(fragment->frame, fragment->offset_pixels);
+            if (scraping_box->scrollAreaReady()) {
+                state = Ready;
+                offset_worker->end(scroll_track);  // The frames still waiting are not needed anymore.
+                return;
+            }
+        }
+    }
+
 private:
     void updateBefore(const Frame &frame) {
         if (readyAfterUpdate(stationary_catcher, frame)) {
@@ -492,30 +1075,18 @@ private:
 
     void startScrolling(const Frame &valid_frame) {
         scraping_box->addScrollArea(valid_frame);
-        previous_descriptor = {valid_frame, initial_descriptor.scroll_bar_length};
+        const FrameDescriptor valid_descriptor = {valid_frame, initial_descriptor.scroll_bar_length};
         is_scrolling = true;
-        on_scroll_updated->send(offset_estimator.position(previous_descriptor).value_or(0.0));
+        on_scroll_updated->send(offset_estimator.position(valid_descriptor).value_or(0.0));
+
+        scroll_track =
+            std::make_shared<ScrollOffsetWorker::Track>(offset_estimator, valid_descriptor, minimum_scroll);
     }
 
+    // The frame is estimated while the scraper checks the next ones.
     void updateScrolling(const Frame &frame) {
-        FrameDescriptor current_fragment = {frame};
-        const auto offset = offset_estimator.estimate(previous_descriptor, current_fragment);
-        if (offset.value_or(-1.0) <= minimum_scroll) {
-            return;
-        }
-
-        const auto position = offset_estimator.position(previous_descriptor);
-        if (position) {
-            on_scroll_updated->send(position.value());
-        }
-
-        scraping_box->addScrollArea(frame, std::lround(offset.value()));
-        if (scraping_box->scrollAreaReady()) {
-            state = Ready;
-            return;
-        }
-
-        previous_descriptor = current_fragment;
+        offset_worker->push(scroll_track, frame);
+        collect(false);
     }
 
     const event_util::Sender<> on_scroll_ready;
@@ -524,11 +1095,12 @@ private:
     const ScrollAreaOffsetEstimator offset_estimator;
     const double initial_scroll;
     const double minimum_scroll;
+    const std::shared_ptr<ScrollOffsetWorker> offset_worker;
 
     std::shared_ptr<PageScrapingBox> scraping_box;
     StationaryFrameCatcher stationary_catcher;
     FrameDescriptor initial_descriptor;
-    FrameDescriptor previous_descriptor;
+    std::shared_ptr<ScrollOffsetWorker::Track> scroll_track;
     ReadyState state = Updatable;
     bool is_scrolling = false;
 };
@@ -538,12 +1110,17 @@ public:
     SceneScraper(
         const scraper_config::SceneScraperConfig &config,
         const std::shared_ptr<PageScrapingBox> &scraping_box,
+        const std::shared_ptr<ScrollOffsetWorker> &offset_worker,
         const event_util::Sender<> &on_scroll_ready,
-        const event_util::Sender<double> &on_scroll_updated)
+        const event_util::Sender<double> &on_scroll_updated,
+        const chrono_util::Clock &clock)
         : config(config)
+        , scroll_area_rect(config.scroll_area_rect)
         , scraping_box(scraping_box)
+        , offset_worker(offset_worker)
         , on_scroll_ready(on_scroll_ready)
-        , on_scroll_updated(on_scroll_updated) {}
+        , on_scroll_updated(on_scroll_updated)
+        , clock(clock) {}
 
     void update(const Frame &frame) {
         if (state == Null) {
@@ -556,18 +1133,30 @@ public:
             readyForStitch();
         }
 
-        if (updateUntilReady(scroll_area_scraper, frame.copy(config.scroll_area_rect))) {
+        if (updateUntilReady(scroll_area_scraper, frame.copy(scroll_area_rect.pixelsFor(frame)))) {
             readyForStitch();
         }
     }
 
     [[nodiscard]] inline bool ready() const { return state == Ready; }
 
+    // True if the page got ready by the fragments estimated since its last frame, as after the user left the page.
+    bool collect(bool wait) {
+        if (state != Updatable) {
+            return false;
+        }
+        scroll_area_scraper->collect(wait);
+        if (scroll_area_scraper->ready()) {
+            readyForStitch();
+        }
+        return ready();
+    }
+
 private:
     void build(const Frame &frame) {
         assert_(state == Null);
 
-        const auto initial_frame = frame.view(config.scroll_area_rect);
+        const auto initial_frame = frame.view(scroll_area_rect.pixelsFor(frame));
         log_debug("{}, {}", initial_frame.size().width(), initial_frame.size().height());
 
         const auto scroll_bar_offset_estimator =
@@ -577,7 +1166,8 @@ private:
             config.stationary_time_threshold,
             config.minimum_color_threshold,
             config.stationary_color_threshold,
-            config.scroll_area_stationary_rect);
+            config.scroll_area_stationary_rect,
+            clock);
 
         if (scroll_bar_offset_estimator.hasScrollbar(initial_frame)) {
             scroll_area_scraper = std::make_unique<ScrollableScrapingInterpreter>(
@@ -586,6 +1176,7 @@ private:
                 stationary_catcher,
                 config.initial_scroll_threshold * initial_frame.height(),
                 config.minimum_scroll_threshold * initial_frame.height(),
+                offset_worker,
                 on_scroll_ready,
                 on_scroll_updated);
         } else {
@@ -596,7 +1187,8 @@ private:
             config.stationary_time_threshold,
             config.minimum_color_threshold,
             config.stationary_color_threshold,
-            config.tab_button_rect);
+            config.tab_button_rect,
+            clock);
 
         state = Updatable;
     }
@@ -612,6 +1204,9 @@ private:
     const event_util::Sender<double> on_scroll_updated;
 
     const scraper_config::SceneScraperConfig config;
+    const LayoutCache<Rect<double>> scroll_area_rect;
+    const std::shared_ptr<ScrollOffsetWorker> offset_worker;
+    const chrono_util::Clock clock;
 
     std::unique_ptr<StationaryFrameCatcher> tab_button_catcher;
     std::unique_ptr<ScrapingInterpreter> scroll_area_scraper;
@@ -625,11 +1220,14 @@ public:
         const StationaryFrameCatcher &base_frame_catcher,
         const Line<double> &snackbar_scan_line,
         const Range<Color> &snackbar_bg_color_range,
-        const uint64 snackbar_time_threshold)
+        const uint64 snackbar_time_threshold,
+        const chrono_util::Clock &clock)
         : base_frame_catcher(base_frame_catcher)
         , snackbar_scan_line(snackbar_scan_line)
         , snackbar_bg_color_range(snackbar_bg_color_range)
-        , snackbar_time_threshold(snackbar_time_threshold) {}
+        , snackbar_time_threshold(snackbar_time_threshold)
+        , clock(clock)
+        , snackbar_sample_plan(snackbar_scan_line) {}
 
     void update(const Frame &frame) {
         if (ready()) {  // Keep the valid image.
@@ -638,9 +1236,10 @@ public:
 
         base_frame_catcher.update(frame);
 
+        const auto now = clock->now();
         if (isSnackbarVisible(frame)) {
-            last_snackbar_visible = frame.timestamp();
-        } else if (frame.timestamp() - last_snackbar_visible.value_or(0) > snackbar_time_threshold) {
+            last_snackbar_visible = now;
+        } else if (now - last_snackbar_visible.value_or(0) > snackbar_time_threshold) {
             last_snackbar_visible = std::nullopt;
         }
     }
@@ -651,12 +1250,14 @@ public:
 
 private:
     [[nodiscard]] bool isSnackbarVisible(const Frame &frame) const {
-        return frame.isIn(snackbar_bg_color_range, snackbar_scan_line);
+        return frame.isIn(snackbar_bg_color_range, snackbar_sample_plan.planFor(frame));
     }
 
     const Line<double> snackbar_scan_line;
     const Range<Color> snackbar_bg_color_range;
     const uint64 snackbar_time_threshold;
+    const chrono_util::Clock clock;
+    const SamplePlanCache snackbar_sample_plan;
 
     StationaryFrameCatcher base_frame_catcher;
     std::optional<uint64> last_snackbar_visible;
@@ -668,15 +1269,15 @@ class CharaDetailSceneScraper {
 public:
     CharaDetailSceneScraper(
         const event_util::Listener<> &on_opened,
-        const event_util::Listener<Frame, SceneInfo> &on_updated,
+        const event_util::Listener<event_util::Shared<Frame>, SceneInfo> &on_updated,
         const event_util::Listener<> &on_closed,
         const event_util::Sender<std::string> &on_closed_before_completed,
         const event_util::Sender<int> &on_scroll_ready,
         const event_util::Sender<int, double> &on_scroll_updated,
         const event_util::Sender<int> &on_page_ready,
-        const event_util::Sender<std::string> &on_completed,
+        const event_util::Sender<event_util::Shared<ScrapingSession>> &on_completed,
         const scraper_config::CharaDetailSceneScraperConfig &config,
-        const std::filesystem::path &scraping_dir)
+        const chrono_util::Clock &clock)
         : on_updated(on_updated)
         , on_opened(on_opened)
         , on_closed(on_closed)
@@ -686,11 +1287,17 @@ public:
         , on_page_ready(on_page_ready)
         , on_completed(on_completed)
         , config(config)
-        , scraping_root_dir(scraping_dir) {
+        , clock(clock)
+        , offset_worker(
+              std::make_shared<scraper_impl::ScrollOffsetWorker>(estimation_backlog, scroll_tracking_counters)) {
+        offset_worker->start();
         this->on_opened->listen([this]() { build(); });
-        this->on_updated->listen([this](const auto &frame, const auto &info) { update(frame, info); });
+        this->on_updated->listen([this](const auto &frame, const auto &info) { update(*frame, info); });
         this->on_closed->listen([this]() {
             log_debug("on_closed");
+            if (state == scraper_impl::Updatable) {
+                collectPages(true);  // The last frames may still be estimated.
+            }
             if (!ready()) {
                 this->on_closed_before_completed->send(std::string{current_uuid});
             }
@@ -698,6 +1305,8 @@ public:
         });
     }
 
+    ~CharaDetailSceneScraper() { offset_worker->join(); }
+
     void build() {
         log_debug("");
         assert_(state == scraper_impl::Null);
@@ -705,25 +1314,31 @@ public:
         current_uuid = uuid_generator.uuid4().str();
 
         scraping_box = std::make_shared<scraper_impl::SceneScrapingBox>(
-            config.skill_scans, config.factor_scans, config.campaign_scans, scraping_root_dir / current_uuid);
+            config.skill_scans, config.factor_scans, config.campaign_scans, current_uuid);
 
         skill_scraper = std::make_unique<scraper_impl::SceneScraper>(
             config.common,
             scraping_box->skill_box(),
+            offset_worker,
             on_scroll_ready->bindLeft(TabPage::SkillPage),
-            on_scroll_updated->bindLeft(TabPage::SkillPage));
+            on_scroll_updated->bindLeft(TabPage::SkillPage),
+            clock);
 
         factor_scraper = std::make_unique<scraper_impl::SceneScraper>(
             config.common,
             scraping_box->factor_box(),
+            offset_worker,
             on_scroll_ready->bindLeft(TabPage::FactorPage),
-            on_scroll_updated->bindLeft(TabPage::FactorPage));
+            on_scroll_updated->bindLeft(TabPage::FactorPage),
+            clock);
 
         campaign_scraper = std::make_unique<scraper_impl::SceneScraper>(
             config.common,
             scraping_box->campaign_box(),
+            offset_worker,
             on_scroll_ready->bindLeft(TabPage::CampaignPage),
-            on_scroll_updated->bindLeft(TabPage::CampaignPage));
+            on_scroll_updated->bindLeft(TabPage::CampaignPage),
+            clock);
 
         base_frame_catcher = std::make_unique<scraper_impl::BaseFrameCatcher>(
             scraper_impl::StationaryFrameCatcher{
@@ -731,10 +1346,12 @@ public:
                 config.common.minimum_color_threshold,
                 config.common.stationary_color_threshold,
                 config.common.base_image_rect,
+                clock,
             },
             config.snackbar_scan_line,
             config.snackbar_color_range,
-            config.snackbar_time_threshold);
+            config.snackbar_time_threshold,
+            clock);
 
         state = scraper_impl::Updatable;
     }
@@ -746,6 +1363,8 @@ public:
             return;
         }
 
+        clock->advance(frame.timestamp());
+
         const auto tab_scraper = tabScraper(scene_info.tab_page);
         if (updateUntilReady(tab_scraper, frame)) {
             on_page_ready->send(scene_info.tab_page);
@@ -757,6 +1376,8 @@ public:
             checkForCompleted();
         }
 
+        collectPages(false);
+
         log_trace("delay={}", chrono_util::timestamp() - frame.timestamp());
     }
 
@@ -769,6 +1390,11 @@ public:
         state = scraper_impl::Null;
     }
 
+    // How often the scroll motion alone was enough to tell the offsets, over every scene.
+    [[nodiscard]] const scraper_impl::ScrollTrackingCounters &scrollTrackingCounters() const {
+        return scroll_tracking_counters;
+    }
+
 private:
     [[nodiscard]] scraper_impl::SceneScraper *tabScraper(TabPage tab_page) const {
         assert_(state == scraper_impl::Updatable);
@@ -782,26 +1408,45 @@ private:
 
     [[nodiscard]] bool ready() const { return state == scraper_impl::Ready; }
 
+    // Every page is collected, since the fragments of a page may be estimated after the user switched to another.
+    void collectPages(bool wait) {
+        for (const auto tab_page : {TabPage::SkillPage, TabPage::FactorPage, TabPage::CampaignPage}) {
+            if (ready()) {
+                return;
+            }
+            if (tabScraper(tab_page)->collect(wait)) {
+                on_page_ready->send(tab_page);
+                checkForCompleted();
+            }
+        }
+    }
+
     void checkForCompleted() {
         assert_(state == scraper_impl::Updatable);
         if (scraping_box->ready()) {
-            on_completed->send(current_uuid);
+            on_completed->send(scraping_box->session());
             state = scraper_impl::Ready;
         }
     }
 
     const event_util::Listener<> on_opened;
-    const event_util::Listener<Frame, SceneInfo> on_updated;
+    const event_util::Listener<event_util::Shared<Frame>, SceneInfo> on_updated;
     const event_util::Listener<> on_closed;
 
     const event_util::Sender<std::string> on_closed_before_completed;
     const event_util::Sender<int> on_scroll_ready;  // When user can start scrolling.
     const event_util::Sender<int, double> on_scroll_updated;  // When user scrolling.
     const event_util::Sender<int> on_page_ready;  // When each page is ready.
-    const event_util::Sender<std::string> on_completed;  // When all three pages are ready.
+    const event_util::Sender<event_util::Shared<ScrapingSession>> on_completed;  // When all three pages are ready.
 
     const scraper_config::CharaDetailSceneScraperConfig config;
-    const std::filesystem::path scraping_root_dir;
+    const chrono_util::Clock clock;
+    const scraper_impl::ScrollTrackingCounters scroll_tracking_counters;
+
+    // Frames of the scroll areas that may wait for their offsets, about a quarter of a second of capture.
+    static constexpr size_t estimation_backlog = 8;
+    // Shared by the pages of every scene, so that no thread is started while the user scrolls.
+    const std::shared_ptr<scraper_impl::ScrollOffsetWorker> offset_worker;
 
     minimal_uuid4::Generator uuid_generator;
 
@@ -5,6 +5,7 @@
 #include <opencv2/opencv.hpp>
 #pragma clang diagnostic ppop
 
+#include "chara_detail/chara_detail_scraping_session.h"
 #include "util/event_util.h"
 
 namespace uma::chara_detail {
@@ -13,26 +14,13 @@ namespace stitcher_impl {
 
 class ScrollAreaStitcher {
 public:
-    [[nodiscard]] cv::Mat stitch(const std::filesystem::path &input_dir) const {
-        const auto &images = stds::transformed<std::vector<cv::Mat>>(
-            imagePaths(input_dir), [](const auto &path) { return cv::imread(path.string(), -1); });
+    [[nodiscard]] cv::Mat stitch(const std::vector<Frame> &fragments) const {
+        const auto &images =
+            stds::transformed<std::vector<cv::Mat>>(fragments, [](const auto &fragment) { return fragment.data(); });
         cv::Mat stitched;
         cv::vconcat(images, stitched);
         return stitched;
     }
-
-private:
-    [[nodiscard]] std::vector<std::filesystem::path> imagePaths(const std::filesystem::path &dir) const {
-        std::vector<std::filesystem::path> paths;
-        for (const auto &entry : std::filesystem::directory_iterator(dir)) {
-            if (entry.is_regular_file()
-                && stds::starts_with(entry.path().filename().string(), path_config.scroll_area.stem())) {
-                paths.push_back(entry.path());
-            }
-        }
-        stds::sort(paths);
-        return paths;
-    }
 };
 
 }  // namespace stitcher_impl
@@ -40,43 +28,37 @@ private:
 class CharaDetailSceneStitcher {
 public:
     CharaDetailSceneStitcher(
-        const std::filesystem::path &scraping_dir,
         const std::filesystem::path &stitching_dir,
-        const event_util::Listener<std::string> &on_stitch_ready,
+        const event_util::Listener<event_util::Shared<ScrapingSession>> &on_stitch_ready,
         const event_util::Sender<std::string> &on_stitch_completed,
         const stitcher_config::CharaDetailSceneStitcherConfig &config)
-        : scraping_root_dir(scraping_dir)
-        , stitching_root_dir(stitching_dir)
+        : stitching_root_dir(stitching_dir)
         , on_stitch_ready(on_stitch_ready)
         , on_stitch_completed(on_stitch_completed)
         , config(config) {
-        on_stitch_ready->listen([this](const auto &id) { stitch(id); });
+        on_stitch_ready->listen([this](const auto &session) { stitch(*session); });
     }
 
-    void stitch(const std::string &id) {
-        const auto input_dir = scraping_root_dir / id;
-        const auto output_dir = stitching_root_dir / id;
-
-        vlog_debug(input_dir.string(), output_dir.string());
+    void stitch(const ScrapingSession &session) {
+        const auto output_dir = stitching_root_dir / session.id;
 
-        Frame base_image(cv::imread((input_dir / path_config.base.filename()).string(), -1));
+        vlog_debug(output_dir.string());
 
-        stitchTab(base_image, input_dir / path_config.skill.stem(), output_dir, path_config.skill);
-        stitchTab(base_image, input_dir / path_config.factor.stem(), output_dir, path_config.factor);
-        stitchTab(base_image, input_dir / path_config.campaign.stem(), output_dir, path_config.campaign);
+        stitchTab(session.base, session.skill, output_dir, path_config.skill);
+        stitchTab(session.base, session.factor, output_dir, path_config.factor);
+        stitchTab(session.base, session.campaign, output_dir, path_config.campaign);
 
-        app::NativeApi::instance().rmdir(input_dir);
-        on_stitch_completed->send(id);
+        on_stitch_completed->send(session.id);
     }
 
 private:
     void stitchTab(
         const Frame &base_image,
-        const std::filesystem::path &input_dir,
+        const ScrapedPage &page,
         const std::filesystem::path &output_dir,
         const PathEntry &path_entry) {
         // Stitch scroll area.
-        auto scroll_area = Frame::fixed(scroll_area_stitcher.stitch(input_dir));
+        auto scroll_area = Frame::fixed(scroll_area_stitcher.stitch(page.scroll_area));
         const auto background_color = scroll_area.colorAt({0.5, 0.0, {ScreenStart, ScreenPixelEnd}});
 
         // Fill scroll bar.
@@ -122,9 +104,7 @@ private:
         }
 
         // Paste tab.
-        canvas.paste(
-            config.tab_button_rect,
-            Frame::fixed(cv::imread((input_dir / path_config.tab_button.filename()).string(), -1)));
+        canvas.paste(config.tab_button_rect, Frame::fixed(page.tab_button.data()));
 
         // Fill stains in base_image.
         // base_image was captured while scrolling, so fragments of the scrolling area will appear at the bottom or top edge.
@@ -137,11 +117,10 @@ private:
     }
 
     const stitcher_config::CharaDetailSceneStitcherConfig config;
-    const std::filesystem::path scraping_root_dir;
     const std::filesystem::path stitching_root_dir;
     const stitcher_impl::ScrollAreaStitcher scroll_area_stitcher;
 
-    const event_util::Listener<std::string> on_stitch_ready;
+    const event_util::Listener<event_util::Shared<ScrapingSession>> on_stitch_ready;
     const event_util::Sender<std::string> on_stitch_completed;
 };
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "chara_detail/chara_detail_config.h"
+#include "core/native_api.h"
+#include "cv/frame.h"
+
+namespace uma::chara_detail {
+
+// Images scraped from a page of the chara detail scene.
+struct ScrapedPage {
+    Frame tab_button;
+    std::vector<Frame> scroll_area;  // Fragments from the top, to be concatenated.
+};
+
+/**
+ * Images scraped from a chara detail scene, which the scraper hands to the stitcher in memory.
+ * A session can be saved for debugging, in the layout of the scraping dir, and loaded again to stitch it later.
+ */
+struct ScrapingSession {
+    std::string id;
+    Frame base;
+    ScrapedPage skill;
+    ScrapedPage factor;
+    ScrapedPage campaign;
+
+    void save(const std::filesystem::path &dir) const {
+        app::NativeApi::instance().mkdir(dir);
+        base.save(dir / path_config.base.filename());
+        savePage(skill, dir / path_config.skill.stem());
+        savePage(factor, dir / path_config.factor.stem());
+        savePage(campaign, dir / path_config.campaign.stem());
+    }
+
+    static ScrapingSession load(const std::filesystem::path &dir, const std::string &id) {
+        return {
+            id,
+            Frame(read(dir / path_config.base.filename())),
+            loadPage(dir / path_config.skill.stem()),
+            loadPage(dir / path_config.factor.stem()),
+            loadPage(dir / path_config.campaign.stem()),
+        };
+    }
+
+private:
+    static void savePage(const ScrapedPage &page, const std::filesystem::path &dir) {
+        app::NativeApi::instance().mkdir(dir);
+        page.tab_button.save(dir / path_config.tab_button.filename());
+        for (int i = 0; i < page.scroll_area.size(); i++) {
+            page.scroll_area[i].save(dir / path_config.scroll_area.withNumber(i, 5).filename());
+        }
+    }
+
+    static ScrapedPage loadPage(const std::filesystem::path &dir) {
+        std::vector<std::filesystem::path> paths;
+        for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.is_regular_file()
+                && stds::starts_with(entry.path().filename().string(), path_config.scroll_area.stem())) {
+                paths.push_back(entry.path());
+            }
+        }
+        stds::sort(paths);
+
+        return {
+            Frame::fixed(read(dir / path_config.tab_button.filename())),
+            stds::transformed<std::vector<Frame>>(paths, [](const auto &path) { return Frame::fixed(read(path)); }),
+        };
+    }
+
+    static cv::Mat read(const std::filesystem::path &path) {
+        cv::Mat image = cv::imread(path.string(), -1);
+        if (image.empty()) {
+            throw std::runtime_error((std::ostringstream() << "Failed to read: " << path.string()).str());
+        }
+        return image;
+    }
+};
+
+}  // namespace uma::chara_detail
@@ -2,11 +2,14 @@
 
 #include <memory>
 #include <optional>
+#include <type_traits>
 #include <vector>
 
 #include <nameof/nameof.hpp>
 
+#include "condition/compiled_condition.h"
 #include "condition/condition.h"
+#include "condition/rule.h"
 #include "condition/serializer.h"
 #include "util/stds.h"
 
@@ -20,6 +23,12 @@ template<typename Base, typename InputType, typename RuleType, typename StateTyp
     return stream.str();
 }
 
+// True if a rule keeps state between frames, so a compiled program must not skip it.
+template<typename StateType>
+[[nodiscard]] constexpr bool isStateful() {
+    return !std::is_empty_v<StateType>;
+}
+
 template<typename InputType, typename RuleType, typename StateType = typename RuleType::state_type>
 class PlainCondition : public Condition<InputType> {
 public:
@@ -33,7 +42,9 @@ public:
     explicit PlainCondition(const RuleType &rule)
         : rule(rule) {}
 
-    void update(const InputType &input) override { met_ = rule.met(input, state); }
+    void update(const InputType &input, const chrono_util::ClockInterface &clock) override {
+        met_ = rule.met(input, state, clock);
+    }
 
     [[nodiscard]] bool met() const override { return met_; }
 
@@ -41,6 +52,18 @@ public:
         return (tag == condition_name) ? this : nullptr;
     }
 
+    size_t lower(Program<InputType> &program) const override {
+        const auto tag = program.tag(condition_name);
+        const auto slot = std::make_shared<StateType>(state);
+        return program.addLeaf(
+            [rule = rule, slot](const InputType &input, const chrono_util::ClockInterface &clock) {
+                return rule.met(input, *slot, clock);
+            },
+            isStateful<StateType>(),
+            tag,
+            this);
+    }
+
     [[nodiscard]] std::string typeName() const { return typeNameOf<decltype(*this), InputType, RuleType, StateType>(); }
 
     static Condition<InputType> *fromJson(const json_util::Json &json) {
@@ -85,9 +108,9 @@ public:
         : rule(rule)
         , child(child) {}
 
-    void update(const InputType &input) override {
-        child->update(input);
-        met_ = rule.met(child->met(), state);
+    void update(const InputType &input, const chrono_util::ClockInterface &clock) override {
+        child->update(input, clock);
+        met_ = rule.met(child->met(), state, clock);
     }
 
     [[nodiscard]] bool met() const override { return met_; }
@@ -96,6 +119,20 @@ public:
         return (name == condition_name) ? this : child->findByTag(name);
     }
 
+    size_t lower(Program<InputType> &program) const override {
+        const auto tag = program.tag(condition_name);
+        const auto slot = std::make_shared<StateType>(state);
+        const auto operand = child->lower(program);
+        return program.addUnary(
+            [rule = rule, slot](bool child_met, const chrono_util::ClockInterface &clock) {
+                return rule.met(child_met, *slot, clock);
+            },
+            isStateful<StateType>(),
+            operand,
+            tag,
+            this);
+    }
+
     [[nodiscard]] std::string typeName() const { return typeNameOf<decltype(*this), InputType, RuleType, StateType>(); }
 
     static Condition<InputType> *fromJson(const json_util::Json &json) {
@@ -125,7 +162,7 @@ private:
 };
 
 template<typename InputType, typename RuleType, typename StateType = typename RuleType::state_type>
-class ParallelCondition : public Condition<InputType> {
+class ParallelCondition : public DetailedCondition<InputType> {
 public:
     using rule_type = RuleType;
     using state_type = StateType;
@@ -143,14 +180,14 @@ public:
         , children(children)
         , condition_name(std::nullopt) {}
 
-    void update(const InputType &input) override {
-        stds::for_each(children, [&](const auto &item) { item->update(input); });
-        met_ = rule.met(metDetail(), state);
+    void update(const InputType &input, const chrono_util::ClockInterface &clock) override {
+        stds::for_each(children, [&](const auto &item) { item->update(input, clock); });
+        met_ = rule.met(metDetail(), state, clock);
     }
 
     [[nodiscard]] bool met() const override { return met_; }
 
-    [[nodiscard]] std::vector<bool> metDetail() const {
+    [[nodiscard]] std::vector<bool> metDetail() const override {
         return stds::transformed<std::vector<bool>>(children, [](const auto &item) { return item->met(); });
     }
 
@@ -165,6 +202,28 @@ public:
             .value_or(nullptr);
     }
 
+    size_t lower(Program<InputType> &program) const override {
+        const auto tag = program.tag(condition_name);
+        const auto operands =
+            stds::transformed<std::vector<size_t>>(children, [&](const auto &item) { return item->lower(program); });
+        // The logical rules are stateless, so they are evaluated inline.
+        if constexpr (std::is_same_v<RuleType, rule::LogicalAnd>) {
+            return program.addAll(operands, tag, this);
+        } else if constexpr (std::is_same_v<RuleType, rule::LogicalOr>) {
+            return program.addAny(operands, tag, this);
+        } else {
+            const auto slot = std::make_shared<StateType>(state);
+            return program.addReduce(
+                [rule = rule, slot](const std::vector<bool> &operand_met, const chrono_util::ClockInterface &clock) {
+                    return rule.met(operand_met, *slot, clock);
+                },
+                isStateful<StateType>(),
+                operands,
+                tag,
+                this);
+        }
+    }
+
     [[nodiscard]] std::string typeName() const { return typeNameOf<decltype(*this), InputType, RuleType, StateType>(); }
 
     static Condition<InputType> *fromJson(const json_util::Json &json) {
@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "condition/condition.h"
+#include "util/metrics_util.h"
+#include "util/misc.h"
+
+namespace uma::condition {
+
+enum EvaluationMode {
+    // Every node is updated on every frame, like the condition tree.
+    Exhaustive,
+    // LogicalAnd and LogicalOr stop at the first decisive child, trying children in the order of measured cost and
+    // selectivity. Skipped subtrees report not met. Subtrees holding stateful rules, like Stable or StableLineLength,
+    // are never skipped, so their states and timing follow the condition tree exactly.
+    // Tagged nodes always evaluate all their children, so metDetail() is exact whenever they are evaluated.
+    ShortCircuit,
+};
+
+/**
+ * A condition tree lowered to a flat array of instructions in post-order, so that one linear pass evaluates every
+ * node without virtual update() calls, shared_ptr indirection or per-frame allocations.
+ * The rules and their states are copied into the program when it is built.
+ */
+template<typename InputType>
+class Program {
+public:
+    using Clock = chrono_util::ClockInterface;
+    using LeafFunction = std::function<bool(const InputType &, const Clock &)>;
+    using UnaryFunction = std::function<bool(bool, const Clock &)>;
+    using ReduceFunction = std::function<bool(const std::vector<bool> &, const Clock &)>;
+
+    enum OpCode : uint8_t {
+        Leaf,
+        Unary,
+        All,
+        Any,
+        Reduce,
+    };
+
+    struct Instruction {
+        OpCode op;
+        uint32_t function;  // Index into the functions of the op code.
+        uint32_t first_operand;  // Index into operands.
+        uint32_t operand_count;
+        uint32_t subtree_begin;  // The first instruction of the subtree of this node.
+        bool tagged;
+        bool stateful;  // The subtree has a rule with state, so it must be evaluated on every frame.
+        const Condition<InputType> *source;
+    };
+
+    // Frames evaluated exhaustively at first, to measure the cost of each node.
+    static constexpr uint64_t calibration_frames = 32;
+    // Children are reordered by their selectivity at this interval.
+    static constexpr uint64_t reorder_interval = 256;
+
+    explicit Program(EvaluationMode mode = Exhaustive)
+        : mode(mode) {}
+
+    // Must be called before the children are lowered, so that tags are kept in the order findByTag visits them.
+    std::optional<size_t> tag(const std::optional<std::string> &name) {
+        if (!name) {
+            return std::nullopt;
+        }
+        tags.emplace_back(name.value(), 0);
+        return tags.size() - 1;
+    }
+
+    size_t addLeaf(
+        const LeafFunction &function,
+        bool stateful,
+        std::optional<size_t> tag,
+        const Condition<InputType> *source) {
+        leaves.push_back(function);
+        return add({Leaf, static_cast<uint32_t>(leaves.size() - 1)}, {}, stateful, tag, source);
+    }
+
+    size_t addUnary(
+        const UnaryFunction &function,
+        bool stateful,
+        size_t operand,
+        std::optional<size_t> tag,
+        const Condition<InputType> *source) {
+        unaries.push_back(function);
+        return add({Unary, static_cast<uint32_t>(unaries.size() - 1)}, {operand}, stateful, tag, source);
+    }
+
+    size_t addAll(
+        const std::vector<size_t> &operand_indices, std::optional<size_t> tag, const Condition<InputType> *source) {
+        return add({All, 0}, operand_indices, false, tag, source);
+    }
+
+    size_t addAny(
+        const std::vector<size_t> &operand_indices, std::optional<size_t> tag, const Condition<InputType> *source) {
+        return add({Any, 0}, operand_indices, false, tag, source);
+    }
+
+    size_t addReduce(
+        const ReduceFunction &function,
+        bool stateful,
+        const std::vector<size_t> &operand_indices,
+        std::optional<size_t> tag,
+        const Condition<InputType> *source) {
+        reducers.push_back(function);
+        reduce_operands.emplace_back(operand_indices.size());
+        return add({Reduce, static_cast<uint32_t>(reducers.size() - 1)}, operand_indices, stateful, tag, source);
+    }
+
+    void run(const InputType &input, const Clock &clock) {
+        if (mode == Exhaustive) {
+            runAll(input, clock, false);
+        } else if (frame_count < calibration_frames) {
+            runAll(input, clock, true);
+        } else {
+            if ((frame_count - calibration_frames) % reorder_interval == 0) {
+                reorder();
+            }
+            leaf_count = 0;
+            evaluate(instructions.size() - 1, input, clock);
+        }
+        frame_count++;
+        settled_ = results == previous_results && !waiting();
+        previous_results = results;
+    }
+
+    // True if the last run repeated the one before it, and no rule waits for time to pass.
+    // Stateful leaves like StableLineLength take one repeated input to converge, so their state is covered by this.
+    [[nodiscard]] bool settled() const { return settled_; }
+
+    [[nodiscard]] bool met(size_t index) const { return results[index]; }
+
+    [[nodiscard]] std::vector<bool> metDetail(size_t index) const {
+        const auto &instruction = instructions[index];
+        std::vector<bool> detail(instruction.operand_count);
+        for (uint32_t k = 0; k < instruction.operand_count; k++) {
+            detail[k] = results[operands[instruction.first_operand + k]];
+        }
+        return detail;
+    }
+
+    [[nodiscard]] const Instruction &instructionAt(size_t index) const { return instructions[index]; }
+
+    [[nodiscard]] size_t size() const { return instructions.size(); }
+
+    // Pairs of a tag and the index of its instruction, in the order of a pre-order traversal of the tree.
+    [[nodiscard]] const std::vector<std::pair<std::string, size_t>> &tagList() const { return tags; }
+
+    // The number of leaves evaluated by the last run.
+    [[nodiscard]] size_t lastLeafCount() const { return leaf_count; }
+
+private:
+    struct Statistics {
+        uint64_t evaluated = 0;
+        uint64_t met = 0;
+        uint64_t nanoseconds = 0;  // Own cost, measured during calibration.
+        double subtree_cost = 1.;  // Average cost of the whole subtree.
+    };
+
+    size_t add(
+        Instruction instruction,
+        const std::vector<size_t> &operand_indices,
+        bool stateful,
+        std::optional<size_t> tag,
+        const Condition<InputType> *source) {
+        const auto index = instructions.size();
+        instruction.first_operand = static_cast<uint32_t>(operands.size());
+        instruction.operand_count = static_cast<uint32_t>(operand_indices.size());
+        instruction.subtree_begin = static_cast<uint32_t>(index);
+        instruction.tagged = tag.has_value();
+        instruction.stateful = stateful;
+        instruction.source = source;
+        for (const auto &operand : operand_indices) {
+            assert_(operand < index);
+            operands.push_back(static_cast<uint32_t>(operand));
+            instruction.subtree_begin = std::min(instruction.subtree_begin, instructions[operand].subtree_begin);
+            instruction.stateful = instruction.stateful || instructions[operand].stateful;
+        }
+        ordered_operands.insert(ordered_operands.end(), operands.end() - operand_indices.size(), operands.end());
+        instructions.push_back(instruction);
+        statistics.emplace_back();
+        results.push_back(false);
+        if (tag) {
+            tags[tag.value()].second = index;
+        }
+        return index;
+    }
+
+    void runAll(const InputType &input, const Clock &clock, bool calibrating) {
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const auto began_at = calibrating ? metrics_util::steadyNanoseconds() : 0;
+            results[i] = step(i, input, clock);
+            if (calibrating) {
+                statistics[i].nanoseconds += metrics_util::steadyNanoseconds() - began_at;
+                statistics[i].evaluated++;
+                statistics[i].met += results[i];
+            }
+        }
+        leaf_count = leaves.size();
+    }
+
+    // Evaluates a node whose operands are already evaluated.
+    bool step(size_t index, const InputType &input, const Clock &clock) {
+        const auto &instruction = instructions[index];
+        const auto *operand = operands.data() + instruction.first_operand;
+        switch (instruction.op) {
+            case Leaf: return leaves[instruction.function](input, clock);
+            case Unary: return unaries[instruction.function](results[operand[0]], clock);
+            case All: {
+                bool met = true;
+                for (uint32_t k = 0; k < instruction.operand_count; k++) {
+                    met = met && results[operand[k]];
+                }
+                return met;
+            }
+            case Any: {
+                bool met = false;
+                for (uint32_t k = 0; k < instruction.operand_count; k++) {
+                    met = met || results[operand[k]];
+                }
+                return met;
+            }
+            case Reduce: {
+                auto &operand_values = reduce_operands[instruction.function];
+                for (uint32_t k = 0; k < instruction.operand_count; k++) {
+                    operand_values[k] = results[operand[k]];
+                }
+                return reducers[instruction.function](operand_values, clock);
+            }
+            default: throw std::logic_error("Unimplemented.");
+        }
+    }
+
+    bool evaluate(size_t index, const InputType &input, const Clock &clock) {
+        const auto &instruction = instructions[index];
+        leaf_count += instruction.op == Leaf;
+        const bool logical = instruction.op == All || instruction.op == Any;
+        if (logical && !instruction.tagged) {
+            const bool decisive = instruction.op == Any;
+            const auto *operand = ordered_operands.data() + instruction.first_operand;
+            bool decided = false;
+            for (uint32_t k = 0; k < instruction.operand_count; k++) {
+                if (decided && !instructions[operand[k]].stateful) {
+                    skip(operand[k]);
+                } else {
+                    const bool met = evaluate(operand[k], input, clock) == decisive;
+                    decided = decided || met;
+                }
+            }
+            results[index] = decided ? decisive : !decisive;
+        } else {
+            const auto *operand = operands.data() + instruction.first_operand;
+            for (uint32_t k = 0; k < instruction.operand_count; k++) {
+                evaluate(operand[k], input, clock);
+            }
+            results[index] = step(index, input, clock);
+        }
+
+        statistics[index].evaluated++;
+        statistics[index].met += results[index];
+        return results[index];
+    }
+
+    // Unary and reduce rules may depend on time, like Stable. They wait while an operand is met but they are not.
+    [[nodiscard]] bool waiting() const {
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const auto &instruction = instructions[i];
+            if ((instruction.op != Unary && instruction.op != Reduce) || results[i]) {
+                continue;
+            }
+            const auto *operand = operands.data() + instruction.first_operand;
+            for (uint32_t k = 0; k < instruction.operand_count; k++) {
+                if (results[operand[k]]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Clears the results of a stateless subtree that is not evaluated in this frame.
+    void skip(size_t index) {
+        for (size_t i = instructions[index].subtree_begin; i <= index; i++) {
+            results[i] = false;
+        }
+    }
+
+    // Sorts the children of logical nodes so that the cheapest child most likely to decide the result comes first.
+    void reorder() {
+        for (size_t i = 0; i < instructions.size(); i++) {
+            auto &stats = statistics[i];
+            if (frame_count == calibration_frames) {
+                stats.subtree_cost = static_cast<double>(stats.nanoseconds) / static_cast<double>(calibration_frames);
+                const auto *operand = operands.data() + instructions[i].first_operand;
+                for (uint32_t k = 0; k < instructions[i].operand_count; k++) {
+                    stats.subtree_cost += statistics[operand[k]].subtree_cost;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const auto &instruction = instructions[i];
+            if (instruction.op != All && instruction.op != Any) {
+                continue;
+            }
+            const auto decisive = instruction.op == Any;
+            const auto rank = [&](uint32_t operand) {
+                const auto &stats = statistics[operand];
+                // Laplace smoothing, so children that were never evaluated are neither preferred nor starved.
+                const auto met_ratio = static_cast<double>(stats.met + 1) / static_cast<double>(stats.evaluated + 2);
+                const auto decisive_ratio = decisive ? met_ratio : 1. - met_ratio;
+                return stats.subtree_cost / decisive_ratio;
+            };
+            const auto begin = ordered_operands.begin() + instruction.first_operand;
+            std::stable_sort(begin, begin + instruction.operand_count, [&](uint32_t a, uint32_t b) {
+                return rank(a) < rank(b);
+            });
+        }
+    }
+
+    const EvaluationMode mode;
+    uint64_t frame_count = 0;
+    size_t leaf_count = 0;
+
+    std::vector<Instruction> instructions;
+    std::vector<uint32_t> operands;
+    std::vector<uint32_t> ordered_operands;  // Operands of logical nodes in the order of evaluation.
+    std::vector<uint8_t> results;
+    std::vector<uint8_t> previous_results;
+    bool settled_ = false;
+    std::vector<Statistics> statistics;
+
+    std::vector<LeafFunction> leaves;
+    std::vector<UnaryFunction> unaries;
+    std::vector<ReduceFunction> reducers;
+    std::vector<std::vector<bool>> reduce_operands;  // Preallocated arguments of the reducers.
+
+    std::vector<std::pair<std::string, size_t>> tags;
+};
+
+template<typename InputType>
+class CompiledCondition;
+
+namespace compiled_impl {
+
+// A node of the compiled tree returned by findByTag. It reads the results of the last run of the program.
+template<typename InputType>
+class CompiledNode : public DetailedCondition<InputType> {
+public:
+    CompiledNode(const CompiledCondition<InputType> *owner, size_t index)
+        : owner(owner)
+        , index(index) {}
+
+    void update(const InputType &, const chrono_util::ClockInterface &) override {
+        throw std::logic_error("Compiled nodes are updated by the whole program.");
+    }
+
+    [[nodiscard]] bool met() const override { return owner->program.met(index); }
+
+    [[nodiscard]] std::vector<bool> metDetail() const override { return owner->program.metDetail(index); }
+
+    [[nodiscard]] const Condition<InputType> *findByTag(const std::string &tag) const override {
+        return owner->findByTag(tag, owner->program.instructionAt(index).subtree_begin, index);
+    }
+
+    [[nodiscard]] std::string typeName() const override { return source()->typeName(); }
+
+    [[nodiscard]] json_util::Json toJson() const override { return source()->toJson(); }
+
+    size_t lower(Program<InputType> &target) const override { return source()->lower(target); }
+
+private:
+    [[nodiscard]] const Condition<InputType> *source() const { return owner->program.instructionAt(index).source; }
+
+    const CompiledCondition<InputType> *owner;
+    const size_t index;
+};
+
+}  // namespace compiled_impl
+
+/**
+ * Drop-in replacement of a condition tree, evaluated by a Program. The source tree is kept for serialization only.
+ */
+template<typename InputType>
+class CompiledCondition : public Condition<InputType> {
+public:
+    explicit CompiledCondition(const std::shared_ptr<Condition<InputType>> &source, EvaluationMode mode = Exhaustive)
+        : source(source)
+        , program(mode) {
+        root = source->lower(program);
+        for (const auto &[name, index] : program.tagList()) {
+            nodes.push_back(std::make_unique<compiled_impl::CompiledNode<InputType>>(this, index));
+        }
+    }
+
+    void update(const InputType &input, const chrono_util::ClockInterface &clock) override {
+        program.run(input, clock);
+    }
+
+    [[nodiscard]] bool met() const override { return program.met(root); }
+
+    [[nodiscard]] bool settled() const override { return program.settled(); }
+
+    [[nodiscard]] const Condition<InputType> *findByTag(const std::string &tag) const override {
+        return findByTag(tag, 0, root);
+    }
+
+    [[nodiscard]] std::string typeName() const override { return source->typeName(); }
+
+    [[nodiscard]] json_util::Json toJson() const override { return source->toJson(); }
+
+    size_t lower(Program<InputType> &target) const override { return source->lower(target); }
+
+    [[nodiscard]] size_t instructionCount() const { return program.size(); }
+
+    [[nodiscard]] size_t lastLeafCount() const { return program.lastLeafCount(); }
+
+private:
+    friend class compiled_impl::CompiledNode<InputType>;
+
+    // Finds the first tag in pre-order whose node is within the instructions [begin, end].
+    [[nodiscard]] const Condition<InputType> *findByTag(const std::string &tag, size_t begin, size_t end) const {
+        const auto &tags = program.tagList();
+        for (size_t i = 0; i < tags.size(); i++) {
+            if (tags[i].first == tag && begin <= tags[i].second && tags[i].second <= end) {
+                return nodes[i].get();
+            }
+        }
+        return nullptr;
+    }
+
+    const std::shared_ptr<Condition<InputType>> source;
+    Program<InputType> program;
+    size_t root = 0;
+    std::vector<std::unique_ptr<compiled_impl::CompiledNode<InputType>>> nodes;
+};
+
+template<typename InputType>
+std::shared_ptr<Condition<InputType>> compile(
+    const std::shared_ptr<Condition<InputType>> &source, EvaluationMode mode = Exhaustive) {
+    return std::make_shared<CompiledCondition<InputType>>(source, mode);
+}
+
+}  // namespace uma::condition
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "util/json_util.h"
+#include "util/misc.h"
 
 namespace uma::condition {
 
+template<typename InputType>
+class Program;
+
 template<typename InputType>
 class Condition {
 public:
@@ -13,16 +18,29 @@ public:
 
     virtual ~Condition() = default;
 
-    virtual void update(const InputType &input) = 0;
+    virtual void update(const InputType &input, const chrono_util::ClockInterface &clock) = 0;
 
     [[nodiscard]] virtual bool met() const = 0;
 
+    // True if updating again with the same input cannot change any result. Conservative unless compiled.
+    [[nodiscard]] virtual bool settled() const { return false; }
+
     [[nodiscard]] virtual const Condition<InputType> *findByTag(const std::string &tag) const = 0;
 
     [[maybe_unused]] [[nodiscard]] virtual std::string typeName() const = 0;
 
     // static Condition<InputType> *fromJson(const json_util::Json &j);
     [[nodiscard]] virtual json_util::Json toJson() const = 0;
+
+    // Appends the instructions of this subtree to the program, and returns the index of the instruction of this node.
+    virtual size_t lower(Program<InputType> &program) const = 0;
+};
+
+// A condition whose children can be read individually, like the tabs of the chara detail scene.
+template<typename InputType>
+class DetailedCondition : public Condition<InputType> {
+public:
+    [[nodiscard]] virtual std::vector<bool> metDetail() const = 0;
 };
 
 }  // namespace uma::condition
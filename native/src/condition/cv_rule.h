@@ -22,11 +22,13 @@ class LineMeasurer {
 public:
     [[maybe_unused]] LineMeasurer(const Line<double> &line, const Range<Color> &color_deviation) noexcept
         : line(line)
-        , color_deviation(color_deviation) {}
+        , color_deviation(color_deviation)
+        , sample_plan(line)
+        , origin(line.p1()) {}
 
     [[nodiscard]] std::optional<double> measure(const Frame &frame) const {
-        const auto &color_range = color_deviation + frame.colorAt(line.p1());
-        return frame.lengthIn(color_range, line);
+        const auto &color_range = color_deviation + frame.colorAt(origin.pixelsFor(frame));
+        return frame.lengthIn(color_range, sample_plan.planFor(frame));
     }
 
     EXTENDED_JSON_TYPE_NDC(LineMeasurer, line, color_deviation);
@@ -34,21 +36,27 @@ public:
 private:
     const Line<double> line;
     const Range<Color> color_deviation;
+    const SamplePlanCache sample_plan;
+    const LayoutCache<Point<double>> origin;
 };
 
 class PointColor : public Rule<Frame, state::Empty> {
 public:
     PointColor(const Point<double> &point, const Range<Color> &color_range) noexcept
         : point(point)
-        , color_range(color_range) {}
+        , color_range(color_range)
+        , pixel(point) {}
 
-    [[nodiscard]] bool met(const Frame &frame, state::Empty &) const override { return frame.isIn(color_range, point); }
+    [[nodiscard]] bool met(const Frame &frame, state::Empty &, const chrono_util::ClockInterface &) const override {
+        return frame.isIn(color_range, pixel.pixelsFor(frame));
+    }
 
     EXTENDED_JSON_TYPE_NDC(PointColor, point, color_range);
 
 private:
     const Point<double> point;
     const Range<Color> color_range;
+    const LayoutCache<Point<double>> pixel;
 };
 
 class LineLength : public Rule<Frame, state::Empty> {
@@ -57,7 +65,7 @@ public:
         : line_measurer(line_measurer)
         , length_range(length_range) {}
 
-    [[nodiscard]] bool met(const Frame &frame, state::Empty &) const override {
+    [[nodiscard]] bool met(const Frame &frame, state::Empty &, const chrono_util::ClockInterface &) const override {
         const auto &length = line_measurer.measure(frame);
         return length.has_value() && length_range.contains(length.value());
     }
@@ -75,7 +83,8 @@ public:
         : line_measurer(line_measurer)
         , length_range(length_range) {}
 
-    [[nodiscard]] bool met(const Frame &frame, state::LengthState &state) const override {
+    [[nodiscard]] bool met(
+        const Frame &frame, state::LengthState &state, const chrono_util::ClockInterface &) const override {
         const auto &length = line_measurer.measure(frame);
         if (!length.has_value() || !length_range.contains(length.value())) {
             state.length = std::nullopt;
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
+
 #include "util/json_util.h"
 #include "util/misc.h"
 #include "util/stds.h"
@@ -9,7 +12,7 @@ namespace uma::state {
 struct Empty {};
 
 struct TimestampState {
-    uint64_t timestamp = 0;
+    std::optional<uint64_t> timestamp;  // Unset while the parent is not met. The first frame of a video is at 0.
 };
 
 }  // namespace uma::state
@@ -26,7 +29,8 @@ public:
 
     virtual ~Rule() = default;
 
-    [[nodiscard]] virtual bool met(const InputType &input, StateType &state) const = 0;
+    [[nodiscard]] virtual bool met(
+        const InputType &input, StateType &state, const chrono_util::ClockInterface &clock) const = 0;
 };
 
 class Stable : public Rule<bool, state::TimestampState> {
@@ -34,15 +38,16 @@ public:
     explicit Stable(int threshold)
         : threshold(threshold) {}
 
-    [[nodiscard]] bool met(const bool &parent, state::TimestampState &state) const override {
+    [[nodiscard]] bool met(
+        const bool &parent, state::TimestampState &state, const chrono_util::ClockInterface &clock) const override {
         if (parent) {
-            if (state.timestamp == 0) {
-                state.timestamp = chrono_util::timestamp();
-            } else if (chrono_util::timestamp() - state.timestamp > threshold) {
+            if (!state.timestamp) {
+                state.timestamp = clock.now();
+            } else if (clock.now() - state.timestamp.value() > threshold) {
                 return true;
             }
         } else {
-            state.timestamp = 0;
+            state.timestamp.reset();
         }
         return false;
     }
@@ -57,7 +62,8 @@ class LogicalAnd : public Rule<std::vector<bool>, state::Empty> {
 public:
     LogicalAnd() = default;
 
-    [[nodiscard]] bool met(const std::vector<bool> &operands, state::Empty &) const override {
+    [[nodiscard]] bool met(
+        const std::vector<bool> &operands, state::Empty &, const chrono_util::ClockInterface &) const override {
         return stds::all_of(operands);
     }
 
@@ -68,7 +74,8 @@ class LogicalOr : public Rule<std::vector<bool>, state::Empty> {
 public:
     LogicalOr() = default;
 
-    [[nodiscard]] bool met(const std::vector<bool> &operands, state::Empty &) const override {
+    [[nodiscard]] bool met(
+        const std::vector<bool> &operands, state::Empty &, const chrono_util::ClockInterface &) const override {
         return stds::any_of(operands);
     }
 
@@ -7,12 +7,19 @@
 #include <runner/window_recorder.h>
 #include <runner/windows_config.h>
 
+#include "benchmark/condition_benchmark.h"
+#include "benchmark/connection_benchmark.h"
+#include "benchmark/ingest_benchmark.h"
+#include "benchmark/ingest_kernels_benchmark.h"
+#include "benchmark/pixel_kernel_benchmark.h"
+#include "benchmark/scroll_offset_benchmark.h"
 #include "builder/chara_detail_recognizer_builder.h"
 #include "builder/chara_detail_scene_context_builder.h"
 #include "builder/chara_detail_scene_scraper_builder.h"
 #include "builder/chara_detail_scene_stitcher_builder.h"
 #include "condition/serializer.h"
 #include "core/native_api.h"
+#include "cv/frame_dump.h"
 #include "cv/video_loader.h"
 #include "util/json_util.h"
 #include "util/logger_util.h"
@@ -44,6 +51,7 @@ json_util::Json createConfig(bool video_mode) {
              {"recognizer", json_util::read(config_dir / "chara_detail" / "recognizer.json")},
          }},
         {"platform", json_util::read(config_dir / "platform.json")},
+        {"event_loop", json_util::read(config_dir / "event_loop.json")},
         {"video_mode", video_mode},
         {"directory",
          {
@@ -55,7 +63,7 @@ json_util::Json createConfig(bool video_mode) {
     };
 }
 
-void captureFromScreen() {
+void captureFromScreen(const std::filesystem::path &dump_path, bool dump_scraping) {
     const auto recorder_runner =
         event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Discard, nullptr, "recorder");
     const auto connection = recorder_runner->makeConnection<cv::Mat, cv::Size, uint64>();
@@ -63,10 +71,14 @@ void captureFromScreen() {
 
     auto &api = app::NativeApi::instance();
     api.setNotifyCallback([](const auto &message) { log_debug("CLI: {}", message); });
-    connection->listen(
-        [&api](const auto &frame, const auto &size, uint64 timestamp) { api.updateFrame(frame, size, timestamp); });
-
-    const auto config = createConfig(false);
+    // The recorder sends the captured BGRA image with the size it is presented as.
+    connection->listen([&api](const auto &frame, const auto &scaled_size, uint64 timestamp) {
+        api.updateFrame(frame, BGRA8888, scaled_size, frame.size(), timestamp);
+    });
+
+    auto config = createConfig(false);
+    config["frame_dump_path"] = dump_path.string();
+    config["dump_scraping"] = dump_scraping;
     api.startEventLoop(config.dump());
 
     const auto windows_config = config["platform"]["windows"].get<windows::windows_config::WindowsConfig>();
@@ -80,7 +92,11 @@ void captureFromScreen() {
     }
 }
 
-void captureFromVideo(const std::vector<std::filesystem::path> &video_path_list) {
+void captureFromVideo(
+    const std::vector<std::filesystem::path> &video_path_list,
+    const video::VideoLoaderConfig &loader_config,
+    const std::filesystem::path &dump_path,
+    bool dump_scraping) {
     const auto recorder_runner =
         event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "recorder");
     const auto connection = recorder_runner->makeConnection<cv::Mat, cv::Size, uint64>();
@@ -90,12 +106,18 @@ void captureFromVideo(const std::vector<std::filesystem::path> &video_path_list)
     connection->listen(
         [&api](const auto &frame, const auto &size, uint64 timestamp) { api.updateFrame(frame, size, timestamp); });
 
-    const auto config = createConfig(true);
+    auto config = createConfig(true);
+    config["frame_dump_path"] = dump_path.string();
+    config["dump_scraping"] = dump_scraping;
     api.startEventLoop(config.dump());
 
+    // Sent on the same runner, so the frames are flushed after the last of them is updated.
+    const auto batch_ended_connection = recorder_runner->makeConnection<>();
+    batch_ended_connection->listen([&api]() { api.flushFrames(); });
+
     recorder_runner->start();
 
-    auto video = video::VideoLoader(connection);
+    auto video = video::VideoLoader(connection, batch_ended_connection, loader_config);
     video.runBatch(video_path_list);
 
     while (api.isRunning()) {
@@ -103,6 +125,40 @@ void captureFromVideo(const std::vector<std::filesystem::path> &video_path_list)
     }
 }
 
+void captureFromDump(const std::vector<std::filesystem::path> &dump_path_list, bool dump_scraping) {
+    const auto recorder_runner =
+        event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "recorder");
+    const auto connection = recorder_runner->makeConnection<cv::Mat, cv::Size, uint64>();
+
+    auto &api = app::NativeApi::instance();
+    api.setNotifyCallback([](const auto &message) { log_debug("CLI: {}", message); });
+    // A dump holds the images as they were passed to the api, BGR or BGRA with the size they are presented as.
+    connection->listen([&api](const auto &frame, const auto &size, uint64 timestamp) {
+        if (frame.type() == CV_8UC4) {
+            api.updateFrame(frame, BGRA8888, size, frame.size(), timestamp);
+        } else {
+            api.updateFrame(frame, frame.size(), timestamp);
+        }
+    });
+
+    auto config = createConfig(true);
+    config["dump_scraping"] = dump_scraping;
+    api.startEventLoop(config.dump());
+
+    const auto batch_ended_connection = recorder_runner->makeConnection<>();
+    batch_ended_connection->listen([&api]() { api.flushFrames(); });
+
+    recorder_runner->start();
+
+    // Outlives the pipeline, since the frames refer to the mapped files.
+    auto loader = frame_dump::FrameDumpLoader(connection, batch_ended_connection);
+    loader.runBatch(dump_path_list);
+
+    while (api.isRunning()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
 void stitchFromImages(const std::string &id) {
     const auto recorder_runner =
         event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "recorder");
@@ -141,6 +197,34 @@ void recognizeFromImages(const std::string &id) {
     }
 }
 
+void runBenchmark(const std::string &target, int count, const std::vector<std::filesystem::path> &input_list) {
+    json_util::Json result;
+    if (target == "connection") {
+        result = tool::ConnectionBenchmark(count).run();
+    } else if (target == "chain") {
+        result = tool::ChainBenchmark(count, std::chrono::microseconds(2000)).run();
+    } else if (target == "payload") {
+        result = tool::PayloadCopyBenchmark(count).run();
+    } else if (target == "pool") {
+        result = tool::PoolBenchmark(count, std::chrono::microseconds(1000)).run();
+    } else if (target == "pixel_difference") {
+        result = tool::PixelDifferenceBenchmark(count).run();
+    } else if (target == "ingest") {
+        result = tool::IngestBenchmark(count).run();
+    } else if (target == "ingest_kernels") {
+        result = tool::IngestKernelBenchmark(count).run();
+    } else if (target == "condition") {
+        result = tool::ConditionBenchmark(createConfig(false)["chara_detail"]["scene_context"], count).run();
+    } else if (target == "scroll_offset") {
+        // The count is the number of frame pairs, which are cropped from frame dumps if there are any.
+        const auto config = createConfig(false);
+        result = tool::ScrollOffsetBenchmark(config["chara_detail"]["scene_scraper"], input_list, count).run();
+    } else {
+        throw std::invalid_argument("Unknown benchmark target: " + target);
+    }
+    std::cout << result.dump(2) << std::endl;
+}
+
 }  // namespace uma::cli
 
 int main(int argc, char **argv) {
@@ -162,18 +246,41 @@ int main(int argc, char **argv) {
         build_command->add_option("--assets_dir", assets_dir)->required();
 
         auto capture_command = command.add_subcommand("capture", "run capture mode");
+        std::filesystem::path dump_path;
+        capture_command->add_option("--dump_path", dump_path, "append the captured frames to a frame dump");
+        bool dump_scraping = false;
+        capture_command->add_flag("--dump_scraping", dump_scraping, "keep the scraped images that failed to stitch");
 
         auto video_command = command.add_subcommand("video", "run capture mode from video");
         std::vector<std::filesystem::path> video_path_list;
         video_command->add_option("--video_path_list", video_path_list)->required();
-
-        auto stitch_command = command.add_subcommand("stitch", "run capture mode from scraped images");
+        uma::video::VideoLoaderConfig loader_config;
+        video_command->add_option("--decoder_threads", loader_config.decoder_threads);
+        video_command->add_option("--prefetch_frames", loader_config.prefetch_frames);
+        video_command->add_option("--target_fps", loader_config.target_fps, "subsample frames, 0 keeps every frame");
+        video_command->add_option("--dump_path", dump_path, "append the decoded frames to a frame dump");
+        video_command->add_flag("--dump_scraping", dump_scraping, "keep the scraped images that failed to stitch");
+
+        auto replay_command = command.add_subcommand("replay", "run capture mode from frame dumps");
+        std::vector<std::filesystem::path> dump_path_list;
+        replay_command->add_option("--dump_path_list", dump_path_list)->required();
+        replay_command->add_flag("--dump_scraping", dump_scraping, "keep the scraped images that failed to stitch");
+
+        auto stitch_command = command.add_subcommand("stitch", "run capture mode from saved scraped images");
         std::string id;
         stitch_command->add_option("--id", id)->required();
 
         auto recognize_command = command.add_subcommand("recognize", "run recognizer mode from stitched images");
         recognize_command->add_option("--id", id)->required();
 
+        auto benchmark_command = command.add_subcommand("benchmark", "run micro benchmarks");
+        std::string benchmark_target;
+        int benchmark_count = 100000;
+        benchmark_command->add_option("--target", benchmark_target)->required();
+        benchmark_command->add_option("--count", benchmark_count);
+        std::vector<std::filesystem::path> benchmark_input_list;
+        benchmark_command->add_option("--input_list", benchmark_input_list, "frame dumps, where a benchmark reads any");
+
         CLI11_PARSE(command, argc, argv)
 
         if (build_command->parsed()) {
@@ -199,11 +306,15 @@ int main(int argc, char **argv) {
         }
 
         if (capture_command->parsed()) {
-            uma::cli::captureFromScreen();
+            uma::cli::captureFromScreen(dump_path, dump_scraping);
         }
 
         if (video_command->parsed()) {
-            uma::cli::captureFromVideo(video_path_list);
+            uma::cli::captureFromVideo(video_path_list, loader_config, dump_path, dump_scraping);
+        }
+
+        if (replay_command->parsed()) {
+            uma::cli::captureFromDump(dump_path_list, dump_scraping);
         }
 
         if (stitch_command->parsed()) {
@@ -213,6 +324,10 @@ int main(int argc, char **argv) {
         if (recognize_command->parsed()) {
             uma::cli::recognizeFromImages(id);
         }
+
+        if (benchmark_command->parsed()) {
+            uma::cli::runBenchmark(benchmark_target, benchmark_count, benchmark_input_list);
+        }
     } catch (std::exception &e) {
         std::cerr << e.what() << std::endl;
         exit(1);
@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <sstream>
+
 #include "chara_detail/chara_detail_recognizer.h"
 #include "chara_detail/chara_detail_scene_context.h"
 #include "chara_detail/chara_detail_scene_scraper.h"
 #include "chara_detail/chara_detail_scene_stitcher.h"
+#include "chara_detail/chara_detail_scraping_session.h"
 #include "util/logger_util.h"
 #include "util/misc.h"
 
@@ -28,37 +32,94 @@ void NativeApi::startEventLoop(const std::string &native_config) {
     const bool video_mode = config_json["video_mode"].get<bool>();
     vlog_debug(video_mode);
 
+    // Frames are scaled to the canonical size at ingest, so the stages resolve the layout of the configs only once.
+    normalize_frames = config_json.value("normalize_frames", true);
+    vlog_debug(normalize_frames);
+    scene_active = false;
+
+    // Every captured frame is also appended to a dump, to be replayed later without decoding.
+    const auto frame_dump_path = config_json.value("frame_dump_path", std::string());
+    frame_dump_writer =
+        frame_dump_path.empty() ? nullptr : std::make_unique<frame_dump::FrameDumpWriter>(frame_dump_path);
+
     log_debug("modules_dir={}", config_json["directory"]["modules_dir"].get<std::string>());
     log_debug("storage_dir={}", config_json["directory"]["storage_dir"].get<std::string>());
     log_debug("temp_dir={}", config_json["directory"]["temp_dir"].get<std::string>());
 
+    // A video is processed as fast as possible, so its frames are timed by their timestamps instead of the wall clock.
     const auto queue_limit_mode = video_mode ? event_util::QueueLimitMode::Block : event_util::QueueLimitMode::Discard;
 
+    // Per-connection overrides. Connections not listed here use the runner default.
+    const auto queue_config = [&](const std::string &name) -> event_util::QueueConfig {
+        const auto &event_loop = config_json.contains("event_loop") ? config_json["event_loop"] : json_util::Json{};
+        const auto profile = video_mode ? "video" : "live";
+        if (event_loop.contains(profile) && event_loop[profile].contains(name)) {
+            return event_loop[profile][name].get<event_util::QueueConfig>();
+        }
+        return {queue_limit_mode, event_util::default_queue_limit_size};
+    };
+
     assert_(event_runners == nullptr);
     event_runners = event_util::makeRunnerController();
+    const auto metrics = std::make_shared<metrics_util::MetricsRegistry>();
+    metrics_report_interval = std::chrono::milliseconds(
+        config_json.contains("event_loop") ? config_json["event_loop"].value("metrics_report_interval", 0) : 0);
 
     const auto distributor_runner =
         event_util::makeSingleThreadRunner(queue_limit_mode, detach_callback, "distributor");
     event_runners->add(distributor_runner);
-    const auto frame_captured_connection = distributor_runner->makeConnection<Frame>();
+    const auto scene_end_timeout_connection = distributor_runner->makeConnection<event_util::TimerId>();
+    const auto frame_captured_connection = distributor_runner->makeConnection<event_util::Shared<Frame>>(
+        queue_config("frame_captured"), event_util::RingBufferBackend);
     on_frame_captured = frame_captured_connection;
+    // Dispatched on the same runner after the frames sent before it.
+    const auto frames_flushed_connection = distributor_runner->makeConnection<>();
+    on_frames_flushed = frames_flushed_connection;
+    metrics->addRunner("distributor", distributor_runner->metrics());
+    metrics->addConnection("frame_captured", event_util::metricsOf(frame_captured_connection));
 
     const auto scraper_runner = event_util::makeSingleThreadRunner(queue_limit_mode, detach_callback, "scraper");
     event_runners->add(scraper_runner);
 
-    const auto chara_detail_updated_connection = scraper_runner->makeConnection<Frame, chara_detail::SceneInfo>();
-    const auto chara_detail_opened_connection = scraper_runner->makeConnection<>();
-    const auto chara_detail_closed_connection = scraper_runner->makeConnection<>();
-
-    chara_detail_opened_connection->listen([this]() { notifyCharaDetailStarted(); });
+    const auto chara_detail_updated_connection =
+        scraper_runner->makeConnection<event_util::Shared<Frame>, chara_detail::SceneInfo>(
+            queue_config("chara_detail_updated"), event_util::RingBufferBackend);
+    const auto chara_detail_opened_connection = scraper_runner->makeConnection<>(queue_config("chara_detail_opened"));
+    const auto chara_detail_closed_connection = scraper_runner->makeConnection<>(queue_config("chara_detail_closed"));
+
+    metrics->addRunner("scraper", scraper_runner->metrics());
+    metrics->addConnection("chara_detail_updated", event_util::metricsOf(chara_detail_updated_connection));
+    metrics->addConnection("chara_detail_opened", event_util::metricsOf(chara_detail_opened_connection));
+    metrics->addConnection("chara_detail_closed", event_util::metricsOf(chara_detail_closed_connection));
+
+    // Frames are held by the two queues, the stage working on each of them, and the stationary catchers
+    // of the scraper, which keep the previous frame of each region.
+    constexpr int frames_held_by_stages = 5;
+    auto &frame_pool = FramePool::instance();
+    frame_pool.setCapacity(
+        queue_config("frame_captured").capacity + queue_config("chara_detail_updated").capacity
+        + frames_held_by_stages);
+    metrics->addCounter("frame_pool_hits", frame_pool.hits());
+    metrics->addCounter("frame_pool_misses", frame_pool.misses());
+    metrics->addCounter("frame_pool_evictions", frame_pool.evictions());
+
+    chara_detail_opened_connection->listen([this]() {
+        scene_active = true;
+        notifyCharaDetailStarted();
+    });
 
     {
         const auto scene_context = std::make_shared<chara_detail::CharaDetailSceneContext>(
-            condition::serializer::conditionFromJson(config_json["chara_detail"]["scene_context"]),
+            condition::compile(
+                condition::serializer::conditionFromJson(config_json["chara_detail"]["scene_context"]),
+                condition::ShortCircuit),
             chara_detail_opened_connection,
             chara_detail_updated_connection,
             chara_detail_closed_connection,
-            std::chrono::milliseconds(1000));
+            std::chrono::milliseconds(1000),
+            event_runners->timers(),
+            scene_end_timeout_connection,
+            chrono_util::makeClock(video_mode));
 
         frame_distributor = std::make_unique<distributor::FrameDistributor>(
             std::vector<std::shared_ptr<distributor::SceneContext>>{
@@ -66,10 +127,15 @@ void NativeApi::startEventLoop(const std::string &native_config) {
             },
             frame_captured_connection,
             nullptr);
+        metrics->addCounter("duplicate_frames_skipped", frame_distributor->skippedFrames());
+        frames_flushed_connection->listen([this]() { frame_distributor->flush(); });
     }
 
+    // Stitching and recognition of different records are independent, so a backlog is processed in parallel.
+    const auto worker_count = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 4);
+
     const auto stitcher_runner =
-        event_util::makeSingleThreadRunner(event_util::QueueLimitMode::NoLimit, detach_callback, "stitcher");
+        event_util::makePoolRunner(worker_count, event_util::QueueLimitMode::NoLimit, detach_callback, "stitcher");
     event_runners->add(stitcher_runner);
 
     const auto closed_before_completed_connection = event_util::makeDirectConnection<std::string>();
@@ -87,12 +153,57 @@ void NativeApi::startEventLoop(const std::string &native_config) {
     const auto page_ready_connection = event_util::makeDirectConnection<int>();
     page_ready_connection->listen([this](int index) { notifyPageReady(index); });
 
-    const auto stitch_ready_connection = stitcher_runner->makeConnection<std::string>();
-    on_stitch_ready = stitch_ready_connection;
+    const auto stitch_ready_connection =
+        stitcher_runner->makeReentrantConnection<event_util::Shared<chara_detail::ScrapingSession>>();
+    metrics->addRunner("stitcher", stitcher_runner->metrics());
+    metrics->addConnection("stitch_ready", event_util::metricsOf(stitch_ready_connection));
+
+    // Scraped images are handed to the stitcher in memory. If dumped, they are saved on the stitcher runner before
+    // they are stitched, and removed once stitched, so that only the scenes that failed to stitch are kept.
+    scraping_dump_dir = json_util::decodePath(config_json["directory"]["temp_dir"]) / "chara_detail";
+    const auto scraping_completed_connection =
+        event_util::makeDirectConnection<event_util::Shared<chara_detail::ScrapingSession>>();
+    if (config_json.value("dump_scraping", false)) {
+        const auto scraping_dump_connection =
+            stitcher_runner->makeReentrantConnection<event_util::Shared<chara_detail::ScrapingSession>>();
+        scraping_dump_connection->listen([this, stitch_ready_connection](const auto &session) {
+            session->save(scraping_dump_dir / session->id);
+            stitch_ready_connection->send(session);
+        });
+        scraping_completed_connection->listen([scraping_dump_connection](const auto &session) {
+            scraping_dump_connection->send(session);
+        });
+        metrics->addConnection("scraping_dump", event_util::metricsOf(scraping_dump_connection));
+    } else {
+        scraping_completed_connection->listen([stitch_ready_connection](const auto &session) {
+            stitch_ready_connection->send(session);
+        });
+    }
+
+    // Debug interface. A dump is loaded on the stitcher runner, not on the thread of the caller.
+    const auto stitch_dump_connection = stitcher_runner->makeReentrantConnection<std::string>();
+    stitch_dump_connection->listen([this, stitch_ready_connection](const std::string &id) {
+        stitch_ready_connection->send(event_util::makeShared<chara_detail::ScrapingSession>(
+            chara_detail::ScrapingSession::load(scraping_dump_dir / id, id)));
+    });
+    on_stitch_ready = stitch_dump_connection;
+
+    chara_detail_scene_scraper = std::make_unique<chara_detail::CharaDetailSceneScraper>(
+        chara_detail_opened_connection,
+        chara_detail_updated_connection,
+        chara_detail_closed_connection,
+        closed_before_completed_connection,
+        scroll_ready_connection,
+        scroll_updated_connection,
+        page_ready_connection,
+        scraping_completed_connection,
+        config_json["chara_detail"]["scene_scraper"].get<chara_detail::scraper_config::CharaDetailSceneScraperConfig>(),
+        chrono_util::makeClock(video_mode));
+    metrics->addCounter("scroll_offsets_predicted", chara_detail_scene_scraper->scrollTrackingCounters().predicted);
+    metrics->addCounter("scroll_offsets_estimated", chara_detail_scene_scraper->scrollTrackingCounters().estimated);
 
-    lap_time_wrapper = event_util::makeDirectConnection<Frame, chara_detail::SceneInfo>();
-    chara_detail_updated_connection->listen([this](const auto &frame, const auto &info) {
-        lap_time_wrapper->send(frame, info);
+    // Listeners run in the order they are added, so these run after the scraper has handled the event.
+    chara_detail_updated_connection->listen([this](const auto &, const auto &) {
         const auto &now = std::chrono::steady_clock::now();
         lap_time_buffer.push_back(now);
         if ((now - lap_time_buffer.front()) > report_interval) {
@@ -102,45 +213,43 @@ void NativeApi::startEventLoop(const std::string &native_config) {
             lap_time_buffer.clear();
         }
     });
-
-    lap_discard_wrapper = event_util::makeDirectConnection<>();
     chara_detail_closed_connection->listen([this]() {
-        lap_discard_wrapper->send();
+        scene_active = false;
         lap_time_buffer.clear();
     });
 
-    const auto scraping_dir = json_util::decodePath(config_json["directory"]["temp_dir"]) / "chara_detail";
-
-    chara_detail_scene_scraper = std::make_unique<chara_detail::CharaDetailSceneScraper>(
-        chara_detail_opened_connection,
-        lap_time_wrapper,
-        lap_discard_wrapper,
-        closed_before_completed_connection,
-        scroll_ready_connection,
-        scroll_updated_connection,
-        page_ready_connection,
-        stitch_ready_connection,
-        config_json["chara_detail"]["scene_scraper"].get<chara_detail::scraper_config::CharaDetailSceneScraperConfig>(),
-        scraping_dir);
-
     const auto recognizer_runner =
-        event_util::makeSingleThreadRunner(event_util::QueueLimitMode::NoLimit, detach_callback, "recognizer");
+        event_util::makePoolRunner(worker_count, event_util::QueueLimitMode::NoLimit, detach_callback, "recognizer");
     event_runners->add(recognizer_runner);
 
-    const auto recognize_ready_connection = recognizer_runner->makeConnection<std::string>();
+    // Both are reentrant, and the recognizer serializes a recognition and an update of the same record.
+    const auto recognize_ready_connection = recognizer_runner->makeReentrantConnection<std::string>();
     on_recognize_ready = recognize_ready_connection;
 
-    const auto update_ready_connection = recognizer_runner->makeConnection<std::string>();
+    const auto update_ready_connection = recognizer_runner->makeReentrantConnection<std::string>();
     on_update_ready = update_ready_connection;
+    metrics->addRunner("recognizer", recognizer_runner->metrics());
+    metrics->addConnection("recognize_ready", event_util::metricsOf(recognize_ready_connection));
+    metrics->addConnection("update_ready", event_util::metricsOf(update_ready_connection));
 
     const auto stitcher_dir =
         json_util::decodePath(config_json["directory"]["storage_dir"]) / "chara_detail" / "active";
 
+    // Runs on the stitcher runner, right after the scene is stitched. A stitch that throws keeps its dump.
+    const auto stitch_completed_connection = event_util::makeDirectConnection<std::string>();
+    stitch_completed_connection->listen([this](const auto &id) {
+        if (std::filesystem::exists(scraping_dump_dir / id)) {
+            rmdir(scraping_dump_dir / id);
+        }
+    });
+    stitch_completed_connection->listen([recognize_ready_connection](const auto &id) {
+        recognize_ready_connection->send(id);
+    });
+
     chara_detail_scene_stitcher = std::make_unique<chara_detail::CharaDetailSceneStitcher>(
-        scraping_dir,
         stitcher_dir,
         stitch_ready_connection,
-        recognize_ready_connection,
+        stitch_completed_connection,
         config_json["chara_detail"]["scene_stitcher"]
             .get<chara_detail::stitcher_config::CharaDetailSceneStitcherConfig>());
 
@@ -160,6 +269,7 @@ void NativeApi::startEventLoop(const std::string &native_config) {
         update_completed_connection,
         config_json["chara_detail"]["recognizer"].get<chara_detail::recognizer_config::CharaDetailRecognizerConfig>());
 
+    metrics_registry = metrics;
     event_runners->start();
 }
 
@@ -183,13 +293,85 @@ bool NativeApi::isRunning() const {
     return event_runners && event_runners->isRunning();
 }
 
+cv::Size NativeApi::frameSizeFor(const cv::Size &size) const {
+    return normalize_frames ? FrameAnchor::canonicalSize(size).toCVSize() : size;
+}
+
 void NativeApi::updateFrame(const cv::Mat &image, const cv::Size &original_size, uint64 timestamp) {
-    on_frame_captured->send({image, timestamp});
+    if (frame_dump_writer) {
+        frame_dump_writer->write(image, timestamp);
+    }
+    const auto size = frameSizeFor(image.size());
+    if (size == image.size()) {
+        dispatchFrame(Frame(image, timestamp), original_size);
+        return;
+    }
+    cv::Mat normalized = FramePool::instance().output();
+    cv::resize(image, normalized, size, 0, 0, cv::INTER_LINEAR);
+    dispatchFrame(Frame(normalized, timestamp), original_size);
+}
+
+// The normalization is part of the resize of the deferred frame, so it costs nothing more.
+void NativeApi::updateFrame(
+    const cv::Mat &raw, PixelFormat format, const cv::Size &size, const cv::Size &original_size, uint64 timestamp) {
+    if (frame_dump_writer) {
+        frame_dump_writer->write(raw.data, raw.cols, raw.rows, raw.step, format, size, timestamp);
+    }
+    dispatchFrame(Frame::deferred(raw, format, frameSizeFor(size), timestamp), original_size);
+}
+
+void NativeApi::updateFrame(
+    const uint8_t *data,
+    int width,
+    int height,
+    size_t row_stride,
+    PixelFormat format,
+    const cv::Size &size,
+    const std::function<VoidCallback> &release,
+    uint64 timestamp) {
+    if (frame_dump_writer) {
+        frame_dump_writer->write(data, width, height, row_stride, format, size, timestamp);
+    }
+    dispatchFrame(
+        Frame::deferred(data, width, height, row_stride, format, frameSizeFor(size), release, timestamp),
+        {width, height});
+}
+
+void NativeApi::dispatchFrame(const Frame &frame, const cv::Size &original_size) {
+    // Signed here once, so the stages that compare frames share the tile hashes. Only the scraper compares regions,
+    // so while no scene is active, a sparse signature is enough to skip duplicate frames.
+    on_frame_captured->send(event_util::makeShared<Frame>(frame.withSignature(!scene_active)));
     const auto &now = std::chrono::steady_clock::now();
     if (now - last_size_reported > report_interval) {
         notifyFrameSizeReported(original_size);
         last_size_reported = now;
     }
+    if (metrics_report_interval != std::chrono::milliseconds::zero()
+        && now - last_metrics_reported > metrics_report_interval) {
+        notifyMetricsReported(metrics_registry->snapshot());
+        last_metrics_reported = now;
+    }
+}
+
+void NativeApi::flushFrames() {
+    assert_(isRunning());
+    on_frames_flushed->send();
+}
+
+std::string NativeApi::metricsSnapshot() const {
+    if (!metrics_registry) {
+        return json_util::Json::object().dump();
+    }
+    return metrics_registry->snapshot().dump();
+}
+
+void NativeApi::stitch(const std::string &id) {
+    assert_(isRunning());
+    if (!std::filesystem::is_directory(scraping_dump_dir / id)) {
+        // Scenes are saved only while dump_scraping is enabled in the config, and kept only if they failed to stitch.
+        throw std::runtime_error((std::ostringstream() << "No scraping dump for id: " << id).str());
+    }
+    on_stitch_ready->send(id);
 }
 
 void NativeApi::updateRecord(const std::string &id) {
@@ -203,6 +385,7 @@ void NativeApi::updateRecord(const std::string &id) {
     startEventLoop({});
     joinEventLoop();
     updateFrame({}, {}, 0);
+    metricsSnapshot();
     setNotifyCallback({});
     setDetachCallback({});
     setMkdirCallback({});
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <functional>
 #include <iostream>
@@ -16,8 +17,10 @@
 
 #include "cv/frame.h"
 #include "cv/frame_distributor.h"
+#include "cv/frame_dump.h"
 #include "util/event_util.h"
 #include "util/json_util.h"
+#include "util/metrics_util.h"
 
 namespace uma::chara_detail {
 class CharaDetailSceneScraper;
@@ -41,13 +44,41 @@ public:
     void joinEventLoop();
     [[nodiscard]] bool isRunning() const;
 
+    // The size a frame of the given size is presented as. Unless disabled in the config, it is normalized so that
+    // the intersection is the canonical 540x960, and platforms that convert eagerly should convert to this size.
+    [[nodiscard]] cv::Size frameSizeFor(const cv::Size &size) const;
+
     void updateFrame(const cv::Mat &image, const cv::Size &original_size, uint64 timestamp);
 
+    // Takes a captured RGBA or BGRA image of any size and stride, presented as a BGR frame of the given size.
+    // The image must not be reused by the caller. It is converted only where it is read, as while a scene is active.
+    void updateFrame(
+        const cv::Mat &raw, PixelFormat format, const cv::Size &size, const cv::Size &original_size, uint64 timestamp);
+
+    // Takes a buffer of the platform without copying it, like a buffer of an image reader that is returned with
+    // release. The buffer is held while any stage may read it, and release may be called from any runner thread.
+    void updateFrame(
+        const uint8_t *data,
+        int width,
+        int height,
+        size_t row_stride,
+        PixelFormat format,
+        const cv::Size &size,
+        const std::function<VoidCallback> &release,
+        uint64 timestamp);
+
+    // No frame follows the last one updated, as at the end of a video. Pending scene ends are fired.
+    void flushFrames();
+
+    // Counters of every runner and queued connection in the event loop, as a JSON string.
+    [[nodiscard]] std::string metricsSnapshot() const;
+
     void notifyScreenshotTaken(const std::string &path, const std::string &resultCode) {
         notify(json_util::Json{{"type", "onScreenshotTaken"}, {"path", path}, {"result", resultCode}}.dump());
     }
 
-    void stitch(const std::string &id) { on_stitch_ready->send(id); }
+    // Stitches a scene again from the images saved by the scraping dump. The dump is removed once it is stitched.
+    void stitch(const std::string &id);
 
     void recognize(const std::string &id) { on_recognize_ready->send(id); }
 
@@ -82,6 +113,10 @@ public:
         notify(json_util::Json{{"type", "onFrameRateReported"}, {"fps", fps}}.dump());
     }
 
+    void notifyMetricsReported(const json_util::Json &metrics) {
+        notify(json_util::Json{{"type", "onMetricsReported"}, {"metrics", metrics}}.dump());
+    }
+
     void notifyFrameSizeReported(const cv::Size &size) {
         notify(json_util::Json{{"type", "onFrameSizeReported"}, {"size", Size<int>{size}}}.dump());
     }
@@ -107,6 +142,8 @@ public:
     }
 
 private:
+    void dispatchFrame(const Frame &frame, const cv::Size &original_size);
+
     void notify(const std::string &message) {
         log_trace(message);
         notify_callback(message);
@@ -124,7 +161,8 @@ private:
 
     event_util::Sender<std::string> on_update_ready;
 
-    event_util::Sender<Frame> on_frame_captured;
+    event_util::Sender<event_util::Shared<Frame>> on_frame_captured;
+    event_util::Sender<> on_frames_flushed;
     event_util::EventRunnerController event_runners;
 
     std::unique_ptr<distributor::FrameDistributor> frame_distributor;
@@ -133,9 +171,14 @@ private:
     std::unique_ptr<chara_detail::CharaDetailRecognizer> chara_detail_recognizer;
 
     const std::chrono::milliseconds report_interval = std::chrono::milliseconds(1000);
-    event_util::Connection<Frame, chara_detail::SceneInfo> lap_time_wrapper;
-    event_util::Connection<> lap_discard_wrapper;
     std::chrono::steady_clock::time_point last_size_reported;
+    std::shared_ptr<metrics_util::MetricsRegistry> metrics_registry;
+    std::chrono::milliseconds metrics_report_interval = std::chrono::milliseconds::zero();  // Zero is disabled.
+    std::chrono::steady_clock::time_point last_metrics_reported;
+    bool normalize_frames = true;
+    std::atomic_bool scene_active = false;  // Set on the scraper runner, read on the thread of the platform.
+    std::unique_ptr<frame_dump::FrameDumpWriter> frame_dump_writer;  // Null unless frames are dumped.
+    std::filesystem::path scraping_dump_dir;
     std::list<std::chrono::steady_clock::time_point> lap_time_buffer;
 
 public:
@@ -1,13 +1,23 @@
 #pragma once
 
+#include <array>
 #include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <utility>
+#include <vector>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Weverything"
 #include <opencv2/opencv.hpp>
 #pragma clang diagnostic ppop
 
+#include "cv/frame_pool.h"
+#include "cv/frame_signature.h"
+#include "cv/frame_source.h"
+#include "cv/pixel_kernel.h"
 #include "types/color.h"
 #include "types/range.h"
 #include "types/shape.h"
@@ -91,6 +101,23 @@ public:
         return {frame_size, intersection};
     }
 
+    // The size a frame is scaled to so that its intersection is exactly the base size, keeping the margins around it.
+    // Frames of this size share one geometry, so the layout of the configs resolves to the same pixels for all of them.
+    static Size<int> canonicalSize(const Size<int> &frame_size) {
+        const Size<double> base = base_size.cast<double>();
+        const Size<double> frame = frame_size.cast<double>();
+        // Margins of whole pixels on both sides, so the intersection is centered as in intersect().
+        const auto margin = [](double length, double base_length) {
+            return std::max(0, static_cast<int>(std::lround((length - base_length) / 2)));
+        };
+        if (frame.width() * base.height() <= frame.height() * base.width()) {
+            const int margin_v = margin(frame.height() * base.width() / frame.width(), base.height());
+            return {base_size.width(), base_size.height() + margin_v * 2};
+        }
+        const int margin_h = margin(frame.width() * base.height() / frame.height(), base.width());
+        return {base_size.width() + margin_h * 2, base_size.height()};
+    }
+
     static FrameAnchor stretched(const Size<int> &frame_size, const Size<int> &screen_size) {
         const auto screen_anchor = intersect(screen_size);
         return {
@@ -140,12 +167,23 @@ public:
 
     [[nodiscard]] inline Rect<int> intersection() const { return intersection_; }
 
+    // Anchors of equal geometry map every shape to the same pixels.
+    [[nodiscard]] inline bool operator==(const FrameAnchor &other) const {
+        const auto &a = intersection_;
+        const auto &b = other.intersection_;
+        return frame_size == other.frame_size && a.left() == b.left() && a.top() == b.top() && a.right() == b.right()
+            && a.bottom() == b.bottom();
+    }
+
+    [[nodiscard]] inline bool operator!=(const FrameAnchor &other) const { return !(*this == other); }
+
     //    [[nodiscard]] static Size<int> baseSize() { return base_size; }
     //    static void setBaseSize(const Size<int> &size) { base_size = size; }
 
 private:
     FrameAnchor(const Size<int> frame_size, const Rect<int> &intersection)
         : unit_size(intersection.width())
+        , frame_size(frame_size)
         , intersection_(intersection)
         , offset_h()
         , offset_v() {
@@ -168,6 +206,7 @@ private:
     }
 
     int unit_size;
+    Size<int> frame_size;
     std::array<double, 6> offset_h;
     std::array<double, 6> offset_v;
     Rect<int> intersection_;
@@ -175,6 +214,62 @@ private:
     inline static Size<int> base_size = {540, 960};
 };
 
+/**
+ * Pixels sampled along a line, resolved to byte offsets for one frame geometry.
+ * The sample points are the same as those of a scan that maps the line on each call.
+ * The points are kept too, for frames whose pixels are resolved from the captured image.
+ */
+class SamplePlan {
+public:
+    SamplePlan(const Size<int> &size, size_t step, const FrameAnchor &anchor, const Line<double> &line)
+        : geometry(geometryOf(size, step, anchor)) {
+        const Line<double> &mapped_line = anchor.mapToFrame(line).cast<double>();
+        ratios = linspace(0., 1., (int) mapped_line.length());
+        offsets.reserve(ratios.size());
+        points.reserve(ratios.size());
+        for (const auto &ratio : ratios) {
+            const auto &p = mapped_line.pointAt(ratio).round();
+            assert_(0 <= p.y() && p.y() < size.height());
+            assert_(0 <= p.x() && p.x() < size.width());
+            offsets.push_back(p.y() * step + p.x() * 3);
+            points.push_back(p);
+        }
+    }
+
+    [[nodiscard]] inline bool matches(const Size<int> &size, size_t step, const FrameAnchor &anchor) const {
+        return geometry == geometryOf(size, step, anchor);
+    }
+
+    [[nodiscard]] inline size_t size() const { return offsets.size(); }
+
+    [[nodiscard]] inline size_t offsetAt(size_t index) const { return offsets[index]; }
+
+    [[nodiscard]] inline const Point<int> &pointAt(size_t index) const { return points[index]; }
+
+    [[nodiscard]] inline double ratioAt(size_t index) const { return ratios[index]; }
+
+private:
+    using Geometry = std::array<size_t, 7>;
+
+    static Geometry geometryOf(const Size<int> &size, size_t step, const FrameAnchor &anchor) {
+        const auto &intersection = anchor.intersection();
+        return {
+            static_cast<size_t>(size.width()),
+            static_cast<size_t>(size.height()),
+            step,
+            static_cast<size_t>(intersection.left()),
+            static_cast<size_t>(intersection.top()),
+            static_cast<size_t>(intersection.right()),
+            static_cast<size_t>(intersection.bottom()),
+        };
+    }
+
+    Geometry geometry;
+    std::vector<size_t> offsets;
+    std::vector<Point<int>> points;
+    std::vector<double> ratios;
+};
+
 struct FrameInfo {
     Rect<int> intersection;
     EXTENDED_JSON_TYPE_NDC(FrameInfo, intersection);
@@ -217,6 +312,33 @@ public:
         return stretched(image, 1, screen_size);
     }
 
+    // The raw image is converted to BGR of the given size only where it is read. See FrameSource.
+    inline static Frame deferred(const cv::Mat &raw, PixelFormat format, const Size<int> &size, uint64 timestamp) {
+        return {std::make_shared<const FrameSource>(raw, format, size), timestamp};
+    }
+
+    // Wraps a 4-channel buffer of the platform without copying. Release is called, on the thread that drops the last
+    // frame referring to the buffer, once no stage can read it anymore.
+    inline static Frame deferred(
+        const uint8_t *data,
+        int width,
+        int height,
+        size_t row_stride,
+        PixelFormat format,
+        const Size<int> &size,
+        const std::function<void()> &release,
+        uint64 timestamp) {
+        assert_(data != nullptr);
+        assert_(row_stride >= static_cast<size_t>(width) * 4);
+        const auto owner = std::shared_ptr<const uint8_t>(data, [release](const uint8_t *) {
+            if (release) {
+                release();
+            }
+        });
+        const auto raw = cv::Mat(height, width, CV_8UC4, const_cast<uint8_t *>(data), row_stride);
+        return {std::make_shared<const FrameSource>(raw, format, size, owner), timestamp};
+    }
+
     inline static Frame open(const std::filesystem::path &path) {
         std::filesystem::path info_path = path;
         info_path.replace_extension(".json");
@@ -225,13 +347,29 @@ public:
         return {image, 1, FrameAnchor::fixed(image.size(), frame_info["intersection"].get<Rect<int>>())};
     }
 
-    [[nodiscard]] inline bool empty() const { return image.empty(); }
+    [[nodiscard]] inline bool empty() const { return !source_ && image.empty(); }
+
+    // True while the pixels are still resolved from the captured image, before anything needed the whole image.
+    [[nodiscard]] inline bool isDeferred() const { return source_ && !source_->materialized(); }
+
+    // Returns this frame with the signature of its pixels. Computed once at ingest, and shared by the copies.
+    // A sparse signature is enough to skip duplicate frames, but not for the regions compared while a scene is active.
+    [[nodiscard]] Frame withSignature(bool sparse = false) const {
+        Frame frame = *this;
+        frame.signature_ = std::make_shared<const FrameSignature>(
+            source_ ? source_->raw() : image, size(), sparse ? FrameSignature::sparse_row_step : 1);
+        return frame;
+    }
+
+    // Null unless the frame was signed by withSignature. Views and clones are not signed.
+    // Kept apart from the frame, so holding it does not hold the buffer of the frame.
+    [[nodiscard]] inline const std::shared_ptr<const FrameSignature> &signature() const { return signature_; }
 
     Frame(const Frame &other) noexcept = default;
 
     Frame &operator=(const Frame &other) noexcept = default;
 
-    [[nodiscard]] inline Size<int> size() const { return image.size(); }
+    [[nodiscard]] inline Size<int> size() const { return source_ ? source_->size() : Size<int>(image.size()); }
 
     [[nodiscard]] inline Rect<int> rect() const { return {{0, 0}, size().toPoint()}; }
 
@@ -245,84 +383,139 @@ public:
         return color_range.contains(colorAt(point));
     }
 
+    [[nodiscard]] bool isIn(const Range<Color> &color_range, const Point<int> &pixel) const {
+        return color_range.contains(colorAt(pixel));
+    }
+
     [[nodiscard]] bool isIn(const Range<Color> &color_range, const Line<double> &line) const {
-        const Range<BGR> &bgr_range = asBGRRange(color_range);
-        const Line<double> &mapped_line = anchor_.mapToFrame(line).cast<double>();
+        return isIn(color_range, samplePlan(line));
+    }
 
-        return stds::any_of(linspace(0., 1., (int) mapped_line.length()), [&](const auto &ratio) {
-            const auto &p = mapped_line.pointAt(ratio).round();
-            return bgr_range.contains(bgrAt(p.x(), p.y()));
-        });
+    [[nodiscard]] bool isIn(const Range<Color> &color_range, const SamplePlan &plan) const {
+        assert_(matches(plan));
+        const auto bgr_range = asBGRRange(color_range);
+        for (size_t i = 0; i < plan.size(); i++) {
+            if (containsAt(bgr_range, plan, i)) {
+                return true;
+            }
+        }
+        return false;
     }
 
     [[nodiscard]] std::optional<double> lengthIn(const Range<Color> &color_range, const Line<double> &line) const {
-        const Range<BGR> &bgr_range = asBGRRange(color_range);
-        const Line<double> &mapped_line = anchor_.mapToFrame(line).cast<double>();
+        return lengthIn(color_range, samplePlan(line));
+    }
 
-        std::optional<double> length = std::nullopt;
-        for (const auto &ratio : linspace(0., 1., (int) mapped_line.length())) {
-            const auto &p = mapped_line.pointAt(ratio).round();
-            if (bgr_range.contains(bgrAt(p.x(), p.y()))) {
-                length = ratio;
-            } else {
-                break;
-            }
+    [[nodiscard]] std::optional<double> lengthIn(const Range<Color> &color_range, const SamplePlan &plan) const {
+        assert_(matches(plan));
+        const auto bgr_range = asBGRRange(color_range);
+        size_t count = 0;
+        while (count < plan.size() && containsAt(bgr_range, plan, count)) {
+            count++;
         }
-        return length;
+        if (count == 0) {
+            return std::nullopt;
+        }
+        return plan.ratioAt(count - 1);
+    }
+
+    [[nodiscard]] inline SamplePlan samplePlan(const Line<double> &line) const {
+        return {size(), planStep(), anchor_, line};
+    }
+
+    [[nodiscard]] inline bool matches(const SamplePlan &plan) const {
+        return plan.matches(size(), planStep(), anchor_);
+    }
+
+    // If bound is given, the sum may stop early once it reaches bound. Then the result is not less than bound.
+    // If both frames are signed and the tiles covering the rect are equal, the pixels are not read at all.
+    [[nodiscard]] uint64 pixelDifference(
+        const Frame &other,
+        const Rect<double> &rect,
+        int ignore_threshold,
+        uint64 bound = std::numeric_limits<uint64>::max()) const {
+        return pixelDifference(other, rect.empty() ? this->rect() : anchor_.mapToFrame(rect), ignore_threshold, bound);
     }
 
-    [[nodiscard]] uint64 pixelDifference(const Frame &other, const Rect<double> &rect, int ignore_threshold) const {
+    // The rect is in pixels, as resolved by a LayoutCache.
+    [[nodiscard]] uint64 pixelDifference(
+        const Frame &other,
+        const Rect<int> &mapped_rect,
+        int ignore_threshold,
+        uint64 bound = std::numeric_limits<uint64>::max()) const {
         assert_(this->size() == other.size());
-        const auto &mapped_rect = rect.empty() ? this->rect() : anchor_.mapToFrame(rect);
-        uint64 total = 0;
-        for (int y = mapped_rect.top(); y < mapped_rect.bottom(); y++) {
-            for (int x = mapped_rect.left(); x < mapped_rect.right(); x++) {
-                const auto &a = bgrAt(x, y);
-                const auto &b = other.bgrAt(x, y);
-                const auto d = a.difference(b);
-                if (d > ignore_threshold) {
-                    total += d;
-                }
-            }
+        if (mapped_rect.width() <= 0 || mapped_rect.height() <= 0) {
+            return 0;
+        }
+        assert_(0 <= mapped_rect.top() && mapped_rect.bottom() <= height());
+        assert_(0 <= mapped_rect.left() && mapped_rect.right() <= width());
+        if (signature_ && other.signature_ && signature_->sameIn(*other.signature_, mapped_rect)) {
+            return 0;
         }
-        return total;
+        const auto &a = mat();
+        const auto &b = other.mat();
+        return pixel_kernel::difference(
+            a.ptr(mapped_rect.top(), mapped_rect.left()),
+            a.step[0],
+            b.ptr(mapped_rect.top(), mapped_rect.left()),
+            b.step[0],
+            mapped_rect.width(),
+            mapped_rect.height(),
+            ignore_threshold,
+            bound);
     }
 
-    [[nodiscard]] inline Color colorAt(const Point<double> &point) const {
-        const auto &p = anchor_.mapToFrame(point);
-        return colorAt(p.x(), p.y());
-    }
+    [[nodiscard]] inline Color colorAt(const Point<double> &point) const { return colorAt(anchor_.mapToFrame(point)); }
+
+    [[nodiscard]] inline Color colorAt(const Point<int> &pixel) const { return colorAt(pixel.x(), pixel.y()); }
 
-    [[nodiscard]] inline const cv::Mat &data() const { return image; }
+    // Converts a deferred frame as a whole.
+    [[nodiscard]] inline const cv::Mat &data() const { return mat(); }
 
     [[nodiscard]] inline uint64 timestamp() const { return timestamp_; }
 
     [[nodiscard]] inline Frame copy(const Rect<double> &rect) const { return view(rect).clone(); }
 
-    [[nodiscard]] inline Frame view(const Rect<double> &rect) const {
-        const auto &r = anchor_.mapToFrame(rect);
-        return view(r.left(), r.top(), r.width(), r.height());
+    [[nodiscard]] inline Frame copy(const Rect<int> &pixels) const { return view(pixels).clone(); }
+
+    [[nodiscard]] inline Frame view(const Rect<double> &rect) const { return view(anchor_.mapToFrame(rect)); }
+
+    [[nodiscard]] inline Frame view(const Rect<int> &pixels) const {
+        return view(pixels.left(), pixels.top(), pixels.width(), pixels.height());
+    }
+
+    // The copy is allocated from the frame pool, since the scraper copies a region of every frame.
+    [[nodiscard]] inline Frame clone() const {
+        const auto &source = mat();
+        cv::Mat image = FramePool::instance().lease(source.size(), source.type());
+        source.copyTo(image);
+        return {image, timestamp_, anchor_};
     }
 
-    [[nodiscard]] inline Frame clone() const { return {image.clone(), timestamp_, anchor_}; }
+    // A copy not from the frame pool, for a frame kept longer than the pipeline holds it, like a scraped image.
+    [[nodiscard]] inline Frame detachedCopy() const { return {mat().clone(), timestamp_, anchor_}; }
 
     void fill(const Rect<double> &rect, const Color &color) {
+        detachSource();
         const auto &r = anchor_.mapToFrame(rect);
         cv::rectangle(image, r.toCVRect(), color.toCVScalar(), cv::FILLED);
+        signature_ = nullptr;
     }
 
     void paste(const Rect<double> &rect, const Frame &source) {
+        detachSource();
         const auto &dest_rect = anchor_.mapToFrame(rect);
         cv::Mat mat;
         if (dest_rect.size() == source.size()) {
-            mat = source.image;
+            mat = source.mat();
         } else {
-            cv::resize(source.image, mat, dest_rect.size().toCVSize(), 0, 0, cv::INTER_LINEAR);
+            cv::resize(source.mat(), mat, dest_rect.size().toCVSize(), 0, 0, cv::INTER_LINEAR);
         }
         mat.copyTo(image(dest_rect.toCVRect()));
+        signature_ = nullptr;
     }
 
-    void save(const std::filesystem::path &path) const { cv::imwrite(path.generic_string(), image); }
+    void save(const std::filesystem::path &path) const { cv::imwrite(path.generic_string(), mat()); }
 
     void dump(const std::filesystem::path &path) const {
         save(path);
@@ -340,23 +533,113 @@ private:
         assert_(this->image.type() == CV_8UC3);
     }
 
-    [[nodiscard]] inline Color colorAt(int x, int y) const { return bgrAt(x, y).toColor(); }
+    Frame(const std::shared_ptr<const FrameSource> &source, uint64 timestamp)
+        : timestamp_(timestamp)
+        , anchor_(FrameAnchor::intersect(source->size()))
+        , source_(source) {}
+
+    [[nodiscard]] inline const cv::Mat &mat() const { return source_ ? source_->materialize() : image; }
+
+    // The materialized image is continuous, so plans for a deferred frame stay valid after it is converted.
+    [[nodiscard]] inline size_t planStep() const {
+        return source_ ? static_cast<size_t>(source_->size().width()) * 3 : image.step[0];
+    }
+
+    // Modifications apply to a frame of its own, not to the image shared by the handles of the source.
+    void detachSource() {
+        if (source_) {
+            image = source_->materialize().clone();
+            source_ = nullptr;
+        }
+    }
+
+    [[nodiscard]] inline bool containsAt(const Range<BGR> &range, const SamplePlan &plan, size_t index) const {
+        if (isDeferred()) {
+            const auto &p = plan.pointAt(index);
+            return contains(range, source_->sample(p.x(), p.y()).data());
+        }
+        return contains(range, mat().data + plan.offsetAt(index));
+    }
+
+    [[nodiscard]] inline Color colorAt(int x, int y) const {
+        if (isDeferred()) {
+            const auto bgr = source_->sample(x, y);
+            return {bgr[2], bgr[1], bgr[0]};
+        }
+        return bgrAt(x, y).toColor();
+    }
+
+    [[nodiscard]] inline static bool contains(const Range<BGR> &range, const uchar *pixel) {
+        const auto &min = range.min();
+        const auto &max = range.max();
+        return (min.b <= pixel[0] && pixel[0] <= max.b) && (min.g <= pixel[1] && pixel[1] <= max.g)
+            && (min.r <= pixel[2] && pixel[2] <= max.r);
+    }
 
     [[nodiscard]] inline const BGR &bgrAt(int x, int y) const {
-        assert_(0 <= y && y < image.size().height);
-        assert_(0 <= x && x < image.size().width);
-        return image.ptr<BGR>(y)[x];
+        assert_(0 <= y && y < height());
+        assert_(0 <= x && x < width());
+        return mat().ptr<BGR>(y)[x];
     }
 
     [[nodiscard]] inline Frame view(int x, int y, int width, int height) const {
-        assert_(0 <= y && (y + height) <= image.size().height);
-        assert_(0 <= x && (x + width) <= image.size().width);
-        return fixed(image({x, y, width, height}), timestamp_);
+        assert_(0 <= y && (y + height) <= this->height());
+        assert_(0 <= x && (x + width) <= this->width());
+        return fixed(mat()({x, y, width, height}), timestamp_);
     }
 
     cv::Mat image;
     uint64 timestamp_;
     FrameAnchor anchor_;
+    std::shared_ptr<const FrameSource> source_;
+    std::shared_ptr<const FrameSignature> signature_;
+};
+
+/**
+ * Keeps the sample plan of a line for the geometry of the last frame, so the line is resolved only when the frame
+ * size changes. Not thread safe, like the rules and estimators that own it.
+ */
+class SamplePlanCache {
+public:
+    explicit SamplePlanCache(const Line<double> &line)
+        : line(line) {}
+
+    [[nodiscard]] const SamplePlan &planFor(const Frame &frame) const {
+        if (!plan || !frame.matches(plan.value())) {
+            plan = frame.samplePlan(line);
+        }
+        return plan.value();
+    }
+
+private:
+    const Line<double> line;
+    mutable std::optional<SamplePlan> plan;
+};
+
+/**
+ * Keeps a point, line or rect of a config resolved to pixels for the geometry of the last frame, like SamplePlanCache.
+ * Normalized frames all have one geometry, so the shape is mapped once, and every later frame reads the pixels.
+ */
+template<typename Shape>
+class LayoutCache {
+public:
+    using Pixels = decltype(std::declval<FrameAnchor>().mapToFrame(std::declval<Shape>()));
+
+    explicit LayoutCache(const Shape &shape)
+        : shape(shape) {}
+
+    [[nodiscard]] inline const Shape &layout() const { return shape; }
+
+    [[nodiscard]] const Pixels &pixelsFor(const Frame &frame) const {
+        if (!resolved || resolved->first != frame.anchor()) {
+            resolved.emplace(frame.anchor(), frame.anchor().mapToFrame(shape));
+        }
+        return resolved->second;
+    }
+
+private:
+    const Shape shape;
+    mutable std::optional<std::pair<FrameAnchor, Pixels>> resolved;
 };
 
 }  // namespace uma
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <memory>
 #include <utility>
 
 #include "chara_detail/chara_detail_scene_context.h"
 #include "condition/condition.h"
 #include "cv/frame.h"
 #include "util/event_util.h"
+#include "util/metrics_util.h"
+#include "util/stds.h"
 
 namespace uma::distributor {
 
@@ -13,16 +16,36 @@ class FrameDistributor {
 public:
     FrameDistributor(
         const std::vector<std::shared_ptr<SceneContext>> &scene_contexts,
-        const event_util::Listener<Frame> &frame_supplier,
-        const event_util::Sender<Frame> &on_no_target)
+        const event_util::Listener<event_util::Shared<Frame>> &frame_supplier,
+        const event_util::Sender<event_util::Shared<Frame>> &on_no_target)
         : scene_contexts(scene_contexts)
         , on_no_target(on_no_target)
         , frame_supplier(frame_supplier) {
         this->frame_supplier->listen([this](const auto &image) { this->update(image); });
     }
 
+    [[nodiscard]] std::shared_ptr<const metrics_util::Counter> skippedFrames() const { return skipped_frames; }
+
+    // Must be called on the runner of the frame supplier, after the last frame.
+    void flush() {
+        for (auto &context : scene_contexts) {
+            context->flush();
+        }
+    }
+
 private:
-    void update(const Frame &image) {
+    // Every scene context receives the same handle. The frame itself is never copied.
+    // A frame identical to the previous one is skipped when no context can change on it, as while the user reads
+    // a screen other than the scenes. The frames must be signed at ingest for this.
+    void update(const event_util::Shared<Frame> &image) {
+        const auto &signature = image->signature();
+        const bool duplicate = signature && previous_signature && *signature == *previous_signature;
+        previous_signature = signature;
+        if (duplicate && stds::all_of(scene_contexts, [](const auto &context) { return context->settled(); })) {
+            skipped_frames->increment();
+            return;
+        }
+
         bool has_active = false;
         for (auto &context : scene_contexts) {
             context->update(image);
@@ -36,8 +59,12 @@ private:
     }
 
     std::vector<std::shared_ptr<SceneContext>> scene_contexts;
-    const event_util::Listener<Frame> frame_supplier;
-    const event_util::Sender<Frame> on_no_target;
+    const event_util::Listener<event_util::Shared<Frame>> frame_supplier;
+    const event_util::Sender<event_util::Shared<Frame>> on_no_target;
+
+    // Only the signature is kept, so the buffer of the previous frame can return to the platform.
+    std::shared_ptr<const FrameSignature> previous_signature;
+    const std::shared_ptr<metrics_util::Counter> skipped_frames = std::make_shared<metrics_util::Counter>();
 };
 
 }  // namespace uma::distributor
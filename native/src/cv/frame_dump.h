@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "cv/ingest_kernels.h"
+#include "types/shape.h"
+#include "util/event_util.h"
+#include "util/logger_util.h"
+#include "util/misc.h"
+
+namespace uma::frame_dump {
+
+// Channels of the frames in a dump. RGBA captures are stored as BGRA, so a replay has a single 4-channel format.
+enum DumpFormat : uint32_t {
+    DumpBGR,
+    DumpBGRA,
+};
+
+/**
+ * Start of a dump file. The frames follow as fixed-size records, each a timestamp and the packed rows of the image.
+ * The header and the records are padded to the alignment, so the images of a mapped file are aligned too.
+ * All values are little-endian.
+ */
+struct DumpHeader {
+    static constexpr char signature[8] = {'U', 'M', 'A', 'F', 'R', 'A', 'M', 'E'};
+    static constexpr uint32_t current_version = 1;
+    static constexpr size_t alignment = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    // The size the frames are presented as, which the platform passed with them.
+    uint32_t frame_width;
+    uint32_t frame_height;
+
+    [[nodiscard]] inline size_t channels() const { return format == DumpBGR ? 3 : 4; }
+    [[nodiscard]] inline size_t imageBytes() const { return static_cast<size_t>(width) * height * channels(); }
+    [[nodiscard]] inline size_t recordBytes() const { return alignment + alignedSize(imageBytes()); }
+
+    static inline size_t alignedSize(size_t bytes) { return (bytes + alignment - 1) / alignment * alignment; }
+};
+static_assert(sizeof(DumpHeader) <= DumpHeader::alignment);
+
+/**
+ * Appends the frames passed to NativeApi to dump files, as they were captured, for replays without decoding.
+ * A frame of another size or format than the current file starts a new file, numbered after the first one.
+ */
+class FrameDumpWriter {
+public:
+    explicit FrameDumpWriter(const std::filesystem::path &path)
+        : path(path) {}
+
+    void write(const cv::Mat &image, uint64 timestamp) {
+        assert_(image.type() == CV_8UC3);
+        append(image.data, image.cols, image.rows, image.step, DumpBGR, false, image.size(), timestamp);
+    }
+
+    void write(
+        const uint8_t *data,
+        int width,
+        int height,
+        size_t row_stride,
+        PixelFormat format,
+        const Size<int> &frame_size,
+        uint64 timestamp) {
+        append(data, width, height, row_stride, DumpBGRA, format == RGBA8888, frame_size, timestamp);
+    }
+
+private:
+    void append(
+        const uint8_t *data,
+        int width,
+        int height,
+        size_t row_stride,
+        DumpFormat format,
+        bool swizzle,
+        const Size<int> &frame_size,
+        uint64 timestamp) {
+        std::lock_guard<std::mutex> lock(mutex);
+        DumpHeader next{};
+        std::memcpy(next.magic, DumpHeader::signature, sizeof(next.magic));
+        next.version = DumpHeader::current_version;
+        next.format = format;
+        next.width = width;
+        next.height = height;
+        next.frame_width = frame_size.width();
+        next.frame_height = frame_size.height();
+        if (!stream.is_open() || std::memcmp(&next, &header, sizeof(DumpHeader)) != 0) {
+            open(next);
+        }
+
+        std::array<char, DumpHeader::alignment> prefix{};
+        const auto timestamp_bytes = static_cast<uint64_t>(timestamp);
+        std::memcpy(prefix.data(), &timestamp_bytes, sizeof(timestamp_bytes));
+        stream.write(prefix.data(), prefix.size());
+
+        const size_t row_bytes = static_cast<size_t>(width) * header.channels();
+        for (int y = 0; y < height; y++) {
+            const auto *row = reinterpret_cast<const char *>(data + y * row_stride);
+            if (!swizzle) {
+                stream.write(row, static_cast<std::streamsize>(row_bytes));
+                continue;
+            }
+            row_buffer.assign(row, row + row_bytes);
+            for (size_t x = 0; x < row_bytes; x += 4) {
+                std::swap(row_buffer[x], row_buffer[x + 2]);
+            }
+            stream.write(row_buffer.data(), static_cast<std::streamsize>(row_bytes));
+        }
+        const std::array<char, DumpHeader::alignment> padding{};
+        const size_t padding_bytes = header.recordBytes() - DumpHeader::alignment - header.imageBytes();
+        stream.write(padding.data(), static_cast<std::streamsize>(padding_bytes));
+    }
+
+    void open(const DumpHeader &next) {
+        if (stream.is_open()) {
+            stream.close();
+        }
+        auto file_path = path;
+        if (file_index > 0) {
+            file_path.replace_filename(
+                (std::ostringstream() << path.stem().string() << "_" << file_index << path.extension().string()).str());
+        }
+        file_index++;
+        vlog_info(file_path.string(), next.width, next.height, next.format);
+
+        stream.open(file_path, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            throw std::runtime_error((std::ostringstream() << "Failed to open: " << file_path.string()).str());
+        }
+        header = next;
+        std::array<char, DumpHeader::alignment> bytes{};
+        std::memcpy(bytes.data(), &header, sizeof(DumpHeader));
+        stream.write(bytes.data(), bytes.size());
+    }
+
+    const std::filesystem::path path;
+    std::mutex mutex;
+    std::ofstream stream;
+    DumpHeader header{};
+    int file_index = 0;
+    std::vector<char> row_buffer;
+};
+
+/**
+ * A dump file mapped to memory. The images are returned as mats over the mapping, without copying,
+ * so they are valid only while the reader lives.
+ * Note that the cli, the only reader of dumps so far, builds only on Windows. The POSIX mapping has no consumer
+ * that builds yet, so dumps can not be replayed on a headless Linux host until the cli builds there.
+ */
+class FrameDumpReader {
+public:
+    explicit FrameDumpReader(const std::filesystem::path &path) {
+        map(path);
+        if (size >= DumpHeader::alignment) {
+            std::memcpy(&header, bytes, sizeof(DumpHeader));
+        }
+        if (size < DumpHeader::alignment || std::memcmp(header.magic, DumpHeader::signature, sizeof(header.magic)) != 0
+            || header.version != DumpHeader::current_version || header.imageBytes() == 0) {
+            unmap();
+            throw std::runtime_error((std::ostringstream() << "Not a frame dump: " << path.string()).str());
+        }
+        // A record cut short by a stopped capture is ignored.
+        count = (size - DumpHeader::alignment) / header.recordBytes();
+    }
+
+    FrameDumpReader(const FrameDumpReader &) = delete;
+    FrameDumpReader &operator=(const FrameDumpReader &) = delete;
+
+    ~FrameDumpReader() { unmap(); }
+
+    [[nodiscard]] inline size_t frameCount() const { return count; }
+
+    [[nodiscard]] inline cv::Size frameSize() const {
+        return {static_cast<int>(header.frame_width), static_cast<int>(header.frame_height)};
+    }
+
+    [[nodiscard]] uint64 timestampAt(size_t index) const {
+        uint64_t timestamp;
+        std::memcpy(&timestamp, record(index), sizeof(timestamp));
+        return timestamp;
+    }
+
+    // BGR, or BGRA for 4-channel captures.
+    [[nodiscard]] cv::Mat imageAt(size_t index) const {
+        const int type = header.format == DumpBGR ? CV_8UC3 : CV_8UC4;
+        return {
+            static_cast<int>(header.height),
+            static_cast<int>(header.width),
+            type,
+            const_cast<uint8_t *>(record(index) + DumpHeader::alignment),
+        };
+    }
+
+private:
+    [[nodiscard]] inline const uint8_t *record(size_t index) const {
+        assert_(index < count);
+        return bytes + DumpHeader::alignment + index * header.recordBytes();
+    }
+
+#if defined(_WIN32)
+    void map(const std::filesystem::path &path) {
+        const HANDLE file = ::CreateFileW(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error((std::ostringstream() << "Failed to open: " << path.string()).str());
+        }
+        LARGE_INTEGER file_size{};
+        if (!::GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            ::CloseHandle(file);
+            throw std::runtime_error((std::ostringstream() << "Failed to map: " << path.string()).str());
+        }
+        // The mapping holds the file, and the view holds the mapping, so both handles can be closed here.
+        const HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        ::CloseHandle(file);
+        void *mapped = mapping ? ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (mapping) {
+            ::CloseHandle(mapping);
+        }
+        if (mapped == nullptr) {
+            throw std::runtime_error((std::ostringstream() << "Failed to map: " << path.string()).str());
+        }
+        bytes = static_cast<const uint8_t *>(mapped);
+        size = static_cast<size_t>(file_size.QuadPart);
+    }
+
+    void unmap() {
+        if (bytes) {
+            ::UnmapViewOfFile(bytes);
+        }
+    }
+#else
+    void map(const std::filesystem::path &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error((std::ostringstream() << "Failed to open: " << path.string()).str());
+        }
+        struct stat status {};
+        if (::fstat(fd, &status) != 0 || status.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error((std::ostringstream() << "Failed to map: " << path.string()).str());
+        }
+        void *mapped = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error((std::ostringstream() << "Failed to map: " << path.string()).str());
+        }
+        ::madvise(mapped, status.st_size, MADV_SEQUENTIAL);
+        bytes = static_cast<const uint8_t *>(mapped);
+        size = static_cast<size_t>(status.st_size);
+    }
+
+    void unmap() {
+        if (bytes) {
+            ::munmap(const_cast<uint8_t *>(bytes), size);
+        }
+    }
+#endif
+
+    const uint8_t *bytes = nullptr;
+    size_t size = 0;
+    DumpHeader header{};
+    size_t count = 0;
+};
+
+/**
+ * Replays dump files through the same connection as VideoLoader, and the recorder of the cli capture.
+ * Each image is sent with the size it is presented as, and without copying, so the files stay mapped until
+ * this is destroyed, when the pipeline no longer holds any frame.
+ * Timestamps are relative to the first frame, and each file continues after the previous one, as in VideoLoader.
+ * The end of the batch is sent after the last frame, as in VideoLoader.
+ */
+class FrameDumpLoader {
+public:
+    explicit FrameDumpLoader(
+        const event_util::Sender<cv::Mat, cv::Size, uint64> &on_frame_captured,
+        const event_util::Sender<> &on_batch_ended = nullptr)
+        : on_frame_captured(on_frame_captured)
+        , on_batch_ended(on_batch_ended) {}
+
+    [[maybe_unused]] void runBatch(const std::vector<std::filesystem::path> &files) {
+        uint64 head_ts = 0;
+        for (const auto &path : files) {
+            vlog_info(path.string());
+            const auto &reader = readers.emplace_back(std::make_unique<FrameDumpReader>(path));
+            if (reader->frameCount() == 0) {
+                continue;
+            }
+            const uint64 first_ts = reader->timestampAt(0);
+            uint64 last_ts = 0;
+            for (size_t i = 0; i < reader->frameCount(); i++) {
+                const auto ts = reader->timestampAt(i) - std::min(first_ts, reader->timestampAt(i));
+                last_ts = std::max(last_ts, ts);
+                on_frame_captured->send(reader->imageAt(i), reader->frameSize(), head_ts + ts);
+            }
+            head_ts += last_ts + 1;  // The first frame of the next file is at zero.
+        }
+        if (on_batch_ended) {
+            on_batch_ended->send();
+        }
+    }
+
+private:
+    const event_util::Sender<cv::Mat, cv::Size, uint64> on_frame_captured;
+    const event_util::Sender<> on_batch_ended;
+    std::vector<std::unique_ptr<FrameDumpReader>> readers;
+};
+
+}  // namespace uma::frame_dump
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "util/metrics_util.h"
+
+namespace uma {
+
+/**
+ * Allocator of frame images that keeps released buffers for reuse, keyed by their byte size.
+ * A mat allocated from the pool returns its buffer here when its last reference is dropped, on whatever thread that is,
+ * so frames need no explicit return. The buffers kept per size are bounded by the number of frames the pipeline
+ * can hold at once, and the rest are freed.
+ * The buffers kept in total are bounded too, since a size may never be leased again, as after the window of the capture
+ * was resized. Over the bound, the buffers of the size leased least recently are freed first.
+ */
+class FramePool : public cv::MatAllocator {
+public:
+    static FramePool &instance() {
+        // Never destroyed, since mats may still be released while static objects are destroyed.
+        static auto *pool = new FramePool();
+        return *pool;
+    }
+
+    void setCapacity(size_t buffers_per_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = buffers_per_size;
+        for (auto &[size, pooled] : free_buffers) {
+            while (pooled.buffers.size() > capacity) {
+                evict(pooled);
+            }
+        }
+        evictOverTotal();
+    }
+
+    // A mat of the size and type whose buffer comes from the pool.
+    [[nodiscard]] cv::Mat lease(const cv::Size &size, int type) {
+        cv::Mat mat = output();
+        mat.create(size, type);
+        return mat;
+    }
+
+    // An empty mat that allocates from the pool, to be passed as the output of OpenCV functions.
+    [[nodiscard]] cv::Mat output() {
+        cv::Mat mat;
+        mat.allocator = this;
+        return mat;
+    }
+
+    [[nodiscard]] std::shared_ptr<const metrics_util::Counter> hits() const { return hit_count; }
+    [[nodiscard]] std::shared_ptr<const metrics_util::Counter> misses() const { return miss_count; }
+    [[nodiscard]] std::shared_ptr<const metrics_util::Counter> evictions() const { return eviction_count; }
+
+    cv::UMatData *allocate(
+        int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag, cv::UMatUsageFlags)
+        const override {
+        // Same layout as the default allocator of OpenCV.
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data && step[i] != cv::Mat::AUTO_STEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        auto *u = new cv::UMatData(this);
+        u->size = total;
+        if (data) {
+            u->data = u->origdata = static_cast<uchar *>(data);
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+            return u;
+        }
+        u->data = u->origdata = take(total);
+        return u;
+    }
+
+    bool allocate(cv::UMatData *u, cv::AccessFlag, cv::UMatUsageFlags) const override { return u != nullptr; }
+
+    void deallocate(cv::UMatData *u) const override {
+        if (!u) {
+            return;
+        }
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            give(u->origdata, u->size);
+            u->origdata = nullptr;
+        }
+        delete u;
+    }
+
+private:
+    FramePool() = default;
+
+    struct PooledBuffers {
+        std::vector<uchar *> buffers;
+        uint64_t last_leased = 0;
+    };
+
+    uchar *take(size_t size) const {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto &pooled = free_buffers[size];
+            pooled.last_leased = ++lease_count;
+            if (!pooled.buffers.empty()) {
+                auto *buffer = pooled.buffers.back();
+                pooled.buffers.pop_back();
+                pooled_count--;
+                hit_count->increment();
+                return buffer;
+            }
+        }
+        miss_count->increment();
+        return static_cast<uchar *>(cv::fastMalloc(size));
+    }
+
+    void give(uchar *buffer, size_t size) const {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto &pooled = free_buffers[size];
+            if (pooled.buffers.size() < capacity) {
+                pooled.buffers.push_back(buffer);
+                pooled_count++;
+                evictOverTotal();
+                return;
+            }
+        }
+        eviction_count->increment();
+        cv::fastFree(buffer);
+    }
+
+    // Must be called with the lock held.
+    void evict(PooledBuffers &pooled) const {
+        cv::fastFree(pooled.buffers.back());
+        pooled.buffers.pop_back();
+        pooled_count--;
+        eviction_count->increment();
+    }
+
+    // Must be called with the lock held. Sizes with no buffer left are forgotten.
+    void evictOverTotal() const {
+        while (pooled_count > capacity * size_classes) {
+            auto oldest = free_buffers.end();
+            for (auto it = free_buffers.begin(); it != free_buffers.end(); it++) {
+                if (!it->second.buffers.empty()
+                    && (oldest == free_buffers.end() || it->second.last_leased < oldest->second.last_leased)) {
+                    oldest = it;
+                }
+            }
+            evict(oldest->second);
+        }
+        for (auto it = free_buffers.begin(); it != free_buffers.end();) {
+            it = it->second.buffers.empty() && it->second.last_leased + forget_after < lease_count
+                ? free_buffers.erase(it)
+                : std::next(it);
+        }
+    }
+
+    // Sizes leased at once by the pipeline: the capture, the frame, and the regions the scraper copies.
+    static constexpr size_t size_classes = 4;
+    // Leases after which an empty size is forgotten, so the sizes kept stay few.
+    static constexpr uint64_t forget_after = 1024;
+
+    mutable std::mutex mutex;
+    mutable std::map<size_t, PooledBuffers> free_buffers;
+    mutable size_t pooled_count = 0;
+    mutable uint64_t lease_count = 0;
+    size_t capacity = 4;
+
+    const std::shared_ptr<metrics_util::Counter> hit_count = std::make_shared<metrics_util::Counter>();
+    const std::shared_ptr<metrics_util::Counter> miss_count = std::make_shared<metrics_util::Counter>();
+    const std::shared_ptr<metrics_util::Counter> eviction_count = std::make_shared<metrics_util::Counter>();
+};
+
+}  // namespace uma
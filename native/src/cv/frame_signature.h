@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "types/shape.h"
+#include "util/misc.h"
+
+namespace uma {
+
+namespace signature_impl {
+
+inline uint64_t mix(uint64_t hash, uint64_t word) {
+    // Each step is a bijection of the hash for a given word, so a change in a single word always changes the result.
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    return (hash << 31) | (hash >> 33);
+}
+
+inline uint64_t hashBytes(uint64_t hash, const uint8_t *bytes, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = mix(hash, word);
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, length - i);
+        hash = mix(hash, word);
+    }
+    return hash;
+}
+
+}  // namespace signature_impl
+
+/**
+ * 64-bit hashes of the square tiles of a frame, computed once when the frame is captured.
+ * If the tiles covering a region have equal hashes in two frames, the pixels there are equal, up to hash collisions,
+ * so the frames can be compared without reading the pixels again.
+ * The hashes are taken from the captured image, which may be larger than the frame it is resampled to.
+ * A sparse signature hashes only every few rows. It is a fraction of the cost, but may miss a change in the rows it
+ * skips, so it only tells duplicate frames apart, and never compares regions.
+ */
+class FrameSignature {
+public:
+    static constexpr int tile_size = 32;
+    static constexpr int sparse_row_step = 8;
+
+    explicit FrameSignature(const cv::Mat &image)
+        : FrameSignature(image, image.size()) {}
+
+    FrameSignature(const cv::Mat &image, const Size<int> &frame_size, int row_step = 1)
+        : width(image.cols)
+        , height(image.rows)
+        , frame_size(frame_size)
+        , row_step(row_step)
+        , columns((image.cols + tile_size - 1) / tile_size)
+        , rows((image.rows + tile_size - 1) / tile_size)
+        , hashes(static_cast<size_t>(columns) * rows, seed) {
+        const size_t row_bytes = image.cols * image.elemSize();
+        const size_t tile_bytes = tile_size * image.elemSize();
+        for (int y = 0; y < image.rows; y += row_step) {
+            const uint8_t *row = image.ptr(y);
+            uint64_t *tile_hashes = hashes.data() + static_cast<size_t>(y / tile_size) * columns;
+            for (int column = 0; column < columns; column++) {
+                const size_t begin = column * tile_bytes;
+                tile_hashes[column] = signature_impl::hashBytes(
+                    tile_hashes[column], row + begin, std::min(tile_bytes, row_bytes - begin));
+            }
+        }
+    }
+
+    // True if the tiles overlapping the rect are equal. The rect is in pixels of the frame.
+    // Frames of equal size may be resampled from captures of different sizes, as after the window was resized.
+    // Their signatures are not comparable, so they are never the same.
+    [[nodiscard]] bool sameIn(const FrameSignature &other, const Rect<int> &rect) const {
+        if (width != other.width || height != other.height || frame_size != other.frame_size || row_step != 1
+            || other.row_step != 1) {
+            return false;
+        }
+        int left = rect.left();
+        int top = rect.top();
+        int right = rect.right();
+        int bottom = rect.bottom();
+        if (frame_size.width() != width || frame_size.height() != height) {
+            // A resampled pixel also reads its neighbours, so one more source pixel is covered on each side.
+            const double scale_x = static_cast<double>(width) / frame_size.width();
+            const double scale_y = static_cast<double>(height) / frame_size.height();
+            left = static_cast<int>(std::floor(left * scale_x)) - 1;
+            top = static_cast<int>(std::floor(top * scale_y)) - 1;
+            right = static_cast<int>(std::ceil(right * scale_x)) + 1;
+            bottom = static_cast<int>(std::ceil(bottom * scale_y)) + 1;
+        }
+        const int first_column = std::max(left, 0) / tile_size;
+        const int first_row = std::max(top, 0) / tile_size;
+        const int last_column = (std::min(right, width) - 1) / tile_size;
+        const int last_row = (std::min(bottom, height) - 1) / tile_size;
+        for (int row = first_row; row <= last_row; row++) {
+            const auto begin = static_cast<size_t>(row) * columns;
+            if (!std::equal(
+                    hashes.begin() + begin + first_column,
+                    hashes.begin() + begin + last_column + 1,
+                    other.hashes.begin() + begin + first_column)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool operator==(const FrameSignature &other) const {
+        return width == other.width && height == other.height && frame_size == other.frame_size
+            && row_step == other.row_step && hashes == other.hashes;
+    }
+
+    [[nodiscard]] bool operator!=(const FrameSignature &other) const { return !(*this == other); }
+
+private:
+    static constexpr uint64_t seed = 0xcbf29ce484222325ULL;
+
+    int width;
+    int height;
+    Size<int> frame_size;
+    int row_step;
+    int columns;
+    int rows;
+    std::vector<uint64_t> hashes;
+};
+
+}  // namespace uma
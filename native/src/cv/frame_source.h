@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "cv/frame_pool.h"
+#include "cv/ingest_kernels.h"
+#include "types/shape.h"
+#include "util/misc.h"
+
+namespace uma {
+
+/**
+ * A captured RGBA or BGRA image of any size and stride, presented as a BGR image of the given size.
+ * Pixels read by the conditions are resolved one by one, and the whole image is resized and converted
+ * only once, when a stage needs it, like the scraper while a scene is active. Both go through the fused kernels,
+ * so a sampled pixel is the same as the one in the materialized image.
+ * Read from several runners through the same frame handle, so materialization is guarded.
+ * An image that does not own its buffer is kept alive by the owner, which is dropped with the last frame.
+ */
+class FrameSource {
+public:
+    FrameSource(
+        const cv::Mat &raw,
+        PixelFormat format,
+        const Size<int> &size,
+        const std::shared_ptr<const void> &owner = nullptr)
+        : raw_(raw)
+        , owner(owner)
+        , format(format)
+        , size_(size)
+        , resampled(size.toCVSize() != raw.size()) {
+        assert_(!raw.empty());
+        assert_(raw.type() == CV_8UC4);
+        assert_(size.width() > 0 && size.height() > 0);
+    }
+
+    [[nodiscard]] inline const Size<int> &size() const { return size_; }
+
+    [[nodiscard]] inline const cv::Mat &raw() const { return raw_; }
+
+    [[nodiscard]] inline bool isResampled() const { return resampled; }
+
+    [[nodiscard]] std::array<uint8_t, 3> sample(int x, int y) const {
+        assert_(0 <= x && x < size_.width());
+        assert_(0 <= y && y < size_.height());
+        return ingest_kernels::sample(
+            raw_.data, raw_.step, raw_.cols, raw_.rows, format, size_.width(), size_.height(), x, y);
+    }
+
+    [[nodiscard]] inline bool materialized() const { return ready.load(std::memory_order_acquire); }
+
+    // The BGR image of the frame size, written into a buffer of the frame pool in a single pass over the raw image.
+    // Converted on the first call, then shared by every reader.
+    [[nodiscard]] const cv::Mat &materialize() const {
+        std::call_once(once, [this]() {
+            image = FramePool::instance().lease(size_.toCVSize(), CV_8UC3);
+            ingest_kernels::resizeToBGR(
+                raw_.data, raw_.step, raw_.cols, raw_.rows, format, image.data, image.step, image.cols, image.rows);
+            ready.store(true, std::memory_order_release);
+        });
+        return image;
+    }
+
+private:
+    const cv::Mat raw_;
+    const std::shared_ptr<const void> owner;
+    const PixelFormat format;
+    const Size<int> size_;
+    const bool resampled;
+
+    mutable std::once_flag once;
+    mutable std::atomic<bool> ready = false;
+    mutable cv::Mat image;
+};
+
+}  // namespace uma
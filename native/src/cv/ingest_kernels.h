@@ -0,0 +1,411 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "cv/pixel_kernel.h"
+
+namespace uma {
+
+// Byte order of the 4-channel images delivered by the platforms.
+enum PixelFormat {
+    RGBA8888,
+    BGRA8888,
+};
+
+}  // namespace uma
+
+namespace uma::ingest_kernels {
+
+using pixel_kernel::Kernel;
+
+namespace kernel_impl {
+
+// Bilinear weights are 7-bit, so a horizontally interpolated channel fits in a signed 16-bit lane.
+constexpr int weight_bits = 7;
+constexpr int weight_one = 1 << weight_bits;
+
+struct Tap {
+    int first;
+    int second;
+    int weight;  // Of the second, in [0, weight_one).
+};
+
+// Same sample positions as cv::resize with INTER_LINEAR.
+inline Tap tapOf(int index, double scale, int limit) {
+    const double position = (index + 0.5) * scale - 0.5;
+    if (position <= 0) {
+        return {0, 0, 0};
+    }
+    const int first = std::min(static_cast<int>(position), limit - 1);
+    const int weight = std::min(static_cast<int>((position - first) * weight_one), weight_one - 1);
+    return {first, std::min(first + 1, limit - 1), weight};
+}
+
+// Offset of the blue channel in a source pixel. Green is always at 1, and red at 2 - blue.
+inline int blueOf(PixelFormat format) { return format == RGBA8888 ? 2 : 0; }
+
+inline int16_t horizontal(const uint8_t *row, const Tap &tap, int channel) {
+    const int a = row[tap.first * 4 + channel];
+    const int b = row[tap.second * 4 + channel];
+    return static_cast<int16_t>(a * (weight_one - tap.weight) + b * tap.weight);
+}
+
+// The rounding of _mm_mulhrs_epi16 and vqrdmulhq_s16, so every kernel produces the same bytes.
+inline uint8_t vertical(int16_t top, int16_t bottom, int weight) {
+    const int blended = top + (((bottom - top) * (weight << 8) + 0x4000) >> 15);
+    return static_cast<uint8_t>((blended + (weight_one / 2)) >> weight_bits);
+}
+
+inline uint8_t boxAverage(const uint8_t *src, size_t src_step, int ratio, int channel) {
+    int sum = 0;
+    for (int dy = 0; dy < ratio; dy++) {
+        const uint8_t *p = src + dy * src_step + channel;
+        for (int dx = 0; dx < ratio; dx++) {
+            sum += p[dx * 4];
+        }
+    }
+    const int area = ratio * ratio;
+    return static_cast<uint8_t>((sum + area / 2) / area);
+}
+
+// Writes one row of packed BGR pixels, each the average of a ratio x ratio block of the source.
+using BoxRowFunction = void (*)(const uint8_t *src, size_t src_step, int ratio, int width, int blue, uint8_t *dst);
+
+// Writes one row of packed BGR pixels, blending two rows that are already interpolated horizontally.
+using BlendRowFunction =
+    void (*)(const int16_t *top, const int16_t *bottom, int weight, int width, int blue, uint8_t *dst);
+
+inline void boxRowScalar(const uint8_t *src, size_t src_step, int ratio, int width, int blue, uint8_t *dst) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t *block = src + x * ratio * 4;
+        dst[x * 3] = boxAverage(block, src_step, ratio, blue);
+        dst[x * 3 + 1] = boxAverage(block, src_step, ratio, 1);
+        dst[x * 3 + 2] = boxAverage(block, src_step, ratio, 2 - blue);
+    }
+}
+
+inline void blendRowScalar(const int16_t *top, const int16_t *bottom, int weight, int width, int blue, uint8_t *dst) {
+    for (int x = 0; x < width; x++) {
+        dst[x * 3] = vertical(top[x * 4 + blue], bottom[x * 4 + blue], weight);
+        dst[x * 3 + 1] = vertical(top[x * 4 + 1], bottom[x * 4 + 1], weight);
+        dst[x * 3 + 2] = vertical(top[x * 4 + 2 - blue], bottom[x * 4 + 2 - blue], weight);
+    }
+}
+
+#if defined(PIXEL_KERNEL_X86)
+
+// Drops the alpha of 4 pixels, and puts the channels in BGR order.
+PIXEL_KERNEL_TARGET("sse4.1")
+inline void storeBGR(__m128i pixels, int blue, uint8_t *dst) {
+    const auto order = blue == 0
+        ? _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+        : _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    alignas(16) uint8_t packed[16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(packed), _mm_shuffle_epi8(pixels, order));
+    std::memcpy(dst, packed, 12);
+}
+
+// Ratios of 1, 2 and 4 have a power-of-two area, so the average is a shift. 4 pixels are written per step.
+PIXEL_KERNEL_TARGET("sse4.1")
+inline void boxRowSSE4(const uint8_t *src, size_t src_step, int ratio, int width, int blue, uint8_t *dst) {
+    if (ratio != 1 && ratio != 2 && ratio != 4) {
+        boxRowScalar(src, src_step, ratio, width, blue, dst);
+        return;
+    }
+    const auto zero = _mm_setzero_si128();
+    const int shift = ratio == 1 ? 0 : (ratio == 2 ? 2 : 4);
+    const auto rounding = _mm_set1_epi16(static_cast<int16_t>((1 << shift) >> 1));
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const uint8_t *block = src + x * ratio * 4;
+        if (ratio == 1) {
+            storeBGR(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block)), blue, dst + x * 3);
+            continue;
+        }
+
+        // Sums of the rows, 2 source pixels of 4 channels per register.
+        __m128i sums[8];
+        for (int k = 0; k < ratio * 2; k++) {
+            sums[k] = zero;
+        }
+        for (int dy = 0; dy < ratio; dy++) {
+            const uint8_t *row = block + dy * src_step;
+            for (int k = 0; k < ratio; k++) {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + k * 16));
+                sums[k * 2] = _mm_add_epi16(sums[k * 2], _mm_unpacklo_epi8(v, zero));
+                sums[k * 2 + 1] = _mm_add_epi16(sums[k * 2 + 1], _mm_unpackhi_epi8(v, zero));
+            }
+        }
+
+        // Each output pixel is the two halves of its register summed.
+        __m128i halves[4];
+        for (int j = 0; j < 4; j++) {
+            halves[j] = ratio == 2 ? sums[j] : _mm_add_epi16(sums[j * 2], sums[j * 2 + 1]);
+        }
+        const auto first =
+            _mm_add_epi16(_mm_unpacklo_epi64(halves[0], halves[1]), _mm_unpackhi_epi64(halves[0], halves[1]));
+        const auto second =
+            _mm_add_epi16(_mm_unpacklo_epi64(halves[2], halves[3]), _mm_unpackhi_epi64(halves[2], halves[3]));
+        const auto averaged = _mm_packus_epi16(
+            _mm_srli_epi16(_mm_add_epi16(first, rounding), shift),
+            _mm_srli_epi16(_mm_add_epi16(second, rounding), shift));
+        storeBGR(averaged, blue, dst + x * 3);
+    }
+    boxRowScalar(src + x * ratio * 4, src_step, ratio, width - x, blue, dst + x * 3);
+}
+
+// 2 pixels of 4 channels, blended and scaled back to 8 bits in 16-bit lanes.
+PIXEL_KERNEL_TARGET("sse4.1")
+inline __m128i blend(const int16_t *top, const int16_t *bottom, __m128i factor) {
+    const auto t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top));
+    const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom));
+    const auto blended = _mm_add_epi16(t, _mm_mulhrs_epi16(_mm_sub_epi16(b, t), factor));
+    return _mm_srli_epi16(_mm_add_epi16(blended, _mm_set1_epi16(weight_one / 2)), weight_bits);
+}
+
+PIXEL_KERNEL_TARGET("sse4.1")
+inline void blendRowSSE4(const int16_t *top, const int16_t *bottom, int weight, int width, int blue, uint8_t *dst) {
+    const auto factor = _mm_set1_epi16(static_cast<int16_t>(weight << 8));
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const auto *t = top + x * 4;
+        const auto *b = bottom + x * 4;
+        storeBGR(_mm_packus_epi16(blend(t, b, factor), blend(t + 8, b + 8, factor)), blue, dst + x * 3);
+    }
+    blendRowScalar(top + x * 4, bottom + x * 4, weight, width - x, blue, dst + x * 3);
+}
+
+#elif defined(PIXEL_KERNEL_NEON)
+
+inline void storeBGR(uint8x16x4_t pixels, int blue, uint8_t *dst) {
+    uint8x16x3_t bgr;
+    bgr.val[0] = pixels.val[blue];
+    bgr.val[1] = pixels.val[1];
+    bgr.val[2] = pixels.val[2 - blue];
+    vst3q_u8(dst, bgr);
+}
+
+// The channels are split by the loads, so the blocks are summed with pairwise additions. 16 pixels per step.
+inline void boxRowNEON(const uint8_t *src, size_t src_step, int ratio, int width, int blue, uint8_t *dst) {
+#if defined(__aarch64__)
+    const bool vectorized = ratio == 1 || ratio == 2 || ratio == 4;
+#else
+    const bool vectorized = ratio == 1 || ratio == 2;
+#endif
+    if (!vectorized) {
+        boxRowScalar(src, src_step, ratio, width, blue, dst);
+        return;
+    }
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t *block = src + x * ratio * 4;
+        if (ratio == 1) {
+            storeBGR(vld4q_u8(block), blue, dst + x * 3);
+            continue;
+        }
+
+        // Sums of horizontally adjacent pairs over the rows, per channel. Each load covers 16 source pixels.
+        uint16x8_t pairs[3][4];
+        for (auto &channel : pairs) {
+            for (auto &sum : channel) {
+                sum = vdupq_n_u16(0);
+            }
+        }
+        for (int dy = 0; dy < ratio; dy++) {
+            const uint8_t *row = block + dy * src_step;
+            for (int k = 0; k < ratio; k++) {
+                const auto pixels = vld4q_u8(row + k * 64);
+                for (int c = 0; c < 3; c++) {
+                    pairs[c][k] = vpadalq_u8(pairs[c][k], pixels.val[c]);
+                }
+            }
+        }
+
+        uint8x16x4_t averaged;
+        for (int c = 0; c < 3; c++) {
+            if (ratio == 2) {
+                averaged.val[c] = vcombine_u8(vrshrn_n_u16(pairs[c][0], 2), vrshrn_n_u16(pairs[c][1], 2));
+            } else {
+#if defined(__aarch64__)
+                averaged.val[c] = vcombine_u8(
+                    vrshrn_n_u16(vpaddq_u16(pairs[c][0], pairs[c][1]), 4),
+                    vrshrn_n_u16(vpaddq_u16(pairs[c][2], pairs[c][3]), 4));
+#endif
+            }
+        }
+        averaged.val[3] = vdupq_n_u8(0);
+        storeBGR(averaged, blue, dst + x * 3);
+    }
+    boxRowScalar(src + x * ratio * 4, src_step, ratio, width - x, blue, dst + x * 3);
+}
+
+// 2 pixels of 4 channels, blended and scaled back to 8 bits.
+inline uint8x8_t blend(const int16_t *top, const int16_t *bottom, int16x8_t factor) {
+    const auto t = vld1q_s16(top);
+    const auto b = vld1q_s16(bottom);
+    return vqrshrun_n_s16(vaddq_s16(t, vqrdmulhq_s16(vsubq_s16(b, t), factor)), weight_bits);
+}
+
+inline void blendRowNEON(const int16_t *top, const int16_t *bottom, int weight, int width, int blue, uint8_t *dst) {
+    const auto factor = vdupq_n_s16(static_cast<int16_t>(weight << 8));
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const auto *t = top + x * 4;
+        const auto *b = bottom + x * 4;
+        alignas(16) uint8_t packed[16];
+        vst1q_u8(packed, vcombine_u8(blend(t, b, factor), blend(t + 8, b + 8, factor)));
+        for (int i = 0; i < 4; i++) {
+            dst[(x + i) * 3] = packed[i * 4 + blue];
+            dst[(x + i) * 3 + 1] = packed[i * 4 + 1];
+            dst[(x + i) * 3 + 2] = packed[i * 4 + 2 - blue];
+        }
+    }
+    blendRowScalar(top + x * 4, bottom + x * 4, weight, width - x, blue, dst + x * 3);
+}
+
+#endif
+
+// AVX2 gains nothing over SSE4.1 here, since the kernels are bound by the loads of the source.
+inline BoxRowFunction boxRowOf(Kernel kernel) {
+    switch (kernel) {
+#if defined(PIXEL_KERNEL_X86)
+        case pixel_kernel::SSE4:
+        case pixel_kernel::AVX2: return boxRowSSE4;
+#elif defined(PIXEL_KERNEL_NEON)
+        case pixel_kernel::NEON: return boxRowNEON;
+#endif
+        default: return boxRowScalar;
+    }
+}
+
+inline BlendRowFunction blendRowOf(Kernel kernel) {
+    switch (kernel) {
+#if defined(PIXEL_KERNEL_X86)
+        case pixel_kernel::SSE4:
+        case pixel_kernel::AVX2: return blendRowSSE4;
+#elif defined(PIXEL_KERNEL_NEON)
+        case pixel_kernel::NEON: return blendRowNEON;
+#endif
+        default: return blendRowScalar;
+    }
+}
+
+inline void horizontalRow(const uint8_t *row, const std::vector<Tap> &taps, int16_t *out) {
+    for (size_t x = 0; x < taps.size(); x++) {
+        out[x * 4] = horizontal(row, taps[x], 0);
+        out[x * 4 + 1] = horizontal(row, taps[x], 1);
+        out[x * 4 + 2] = horizontal(row, taps[x], 2);
+        out[x * 4 + 3] = 0;
+    }
+}
+
+}  // namespace kernel_impl
+
+// The ratio of the box filter, if the destination is the source scaled down by the same integer in both directions.
+[[nodiscard]] inline int boxRatio(int src_width, int src_height, int dst_width, int dst_height) {
+    if (dst_width <= 0 || dst_height <= 0 || src_width % dst_width != 0) {
+        return 0;
+    }
+    const int ratio = src_width / dst_width;
+    return src_height == dst_height * ratio ? ratio : 0;
+}
+
+/**
+ * Resizes an RGBA or BGRA image and converts it to packed BGR in a single pass over the source, instead of
+ * a resize followed by a color conversion. An integer ratio averages each block of source pixels, like INTER_AREA.
+ * Other sizes are interpolated at the sample positions of INTER_LINEAR, with 7-bit weights.
+ * Every kernel writes the same bytes, and sample() returns them for single pixels.
+ */
+inline void resizeToBGR(
+    const uint8_t *src,
+    size_t src_step,
+    int src_width,
+    int src_height,
+    PixelFormat format,
+    uint8_t *dst,
+    size_t dst_step,
+    int dst_width,
+    int dst_height,
+    Kernel kernel = pixel_kernel::bestKernel()) {
+    const int blue = kernel_impl::blueOf(format);
+    const int ratio = boxRatio(src_width, src_height, dst_width, dst_height);
+    if (ratio > 0) {
+        const auto box_row = kernel_impl::boxRowOf(kernel);
+        for (int y = 0; y < dst_height; y++) {
+            box_row(src + y * ratio * src_step, src_step, ratio, dst_width, blue, dst + y * dst_step);
+        }
+        return;
+    }
+
+    std::vector<kernel_impl::Tap> taps(dst_width);
+    const double scale_x = static_cast<double>(src_width) / dst_width;
+    for (int x = 0; x < dst_width; x++) {
+        taps[x] = kernel_impl::tapOf(x, scale_x, src_width);
+    }
+
+    // The two source rows in use, interpolated horizontally. Reused while consecutive rows share them.
+    std::vector<int16_t> rows[2] = {std::vector<int16_t>(dst_width * 4), std::vector<int16_t>(dst_width * 4)};
+    int cached[2] = {-1, -1};
+    const auto rowOf = [&](int index) -> const int16_t * {
+        for (int i = 0; i < 2; i++) {
+            if (cached[i] == index) {
+                return rows[i].data();
+            }
+        }
+        const int slot = cached[0] < cached[1] ? 0 : 1;  // The upper one is no longer needed.
+        kernel_impl::horizontalRow(src + index * src_step, taps, rows[slot].data());
+        cached[slot] = index;
+        return rows[slot].data();
+    };
+
+    const auto blend_row = kernel_impl::blendRowOf(kernel);
+    const double scale_y = static_cast<double>(src_height) / dst_height;
+    for (int y = 0; y < dst_height; y++) {
+        const auto tap = kernel_impl::tapOf(y, scale_y, src_height);
+        const int16_t *top = rowOf(tap.first);
+        const int16_t *bottom = rowOf(tap.second);
+        blend_row(top, bottom, tap.weight, dst_width, blue, dst + y * dst_step);
+    }
+}
+
+// The BGR pixel at (x, y) that resizeToBGR writes, computed from the source pixels it covers only.
+[[nodiscard]] inline std::array<uint8_t, 3> sample(
+    const uint8_t *src,
+    size_t src_step,
+    int src_width,
+    int src_height,
+    PixelFormat format,
+    int dst_width,
+    int dst_height,
+    int x,
+    int y) {
+    const int blue = kernel_impl::blueOf(format);
+    const int ratio = boxRatio(src_width, src_height, dst_width, dst_height);
+    if (ratio > 0) {
+        const uint8_t *block = src + y * ratio * src_step + x * ratio * 4;
+        return {
+            kernel_impl::boxAverage(block, src_step, ratio, blue),
+            kernel_impl::boxAverage(block, src_step, ratio, 1),
+            kernel_impl::boxAverage(block, src_step, ratio, 2 - blue),
+        };
+    }
+
+    const auto tap_x = kernel_impl::tapOf(x, static_cast<double>(src_width) / dst_width, src_width);
+    const auto tap_y = kernel_impl::tapOf(y, static_cast<double>(src_height) / dst_height, src_height);
+    const uint8_t *top = src + tap_y.first * src_step;
+    const uint8_t *bottom = src + tap_y.second * src_step;
+    const auto channel = [&](int c) {
+        return kernel_impl::vertical(
+            kernel_impl::horizontal(top, tap_x, c), kernel_impl::horizontal(bottom, tap_x, c), tap_y.weight);
+    };
+    return {channel(blue), channel(1), channel(2 - blue)};
+}
+
+}  // namespace uma::ingest_kernels
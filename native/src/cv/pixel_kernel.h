@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_KERNEL_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXEL_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+// MSVC compiles any intrinsic anywhere, while GCC and Clang need the target of each function to be declared.
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXEL_KERNEL_TARGET(name) __attribute__((target(name)))
+#else
+#define PIXEL_KERNEL_TARGET(name)
+#endif
+
+namespace uma::pixel_kernel {
+
+enum Kernel {
+    Scalar,
+    SSE4,
+    AVX2,
+    NEON,
+};
+
+namespace kernel_impl {
+
+// Sum of the per-pixel BGR absolute differences that are above the threshold, for one row of packed BGR pixels.
+using DifferenceRowFunction = uint64_t (*)(const uint8_t *a, const uint8_t *b, int width, int ignore_threshold);
+
+inline uint64_t differenceRowScalar(const uint8_t *a, const uint8_t *b, int width, int ignore_threshold) {
+    uint64_t total = 0;
+    for (int i = 0; i < width * 3; i += 3) {
+        const int d = std::abs(a[i] - b[i]) + std::abs(a[i + 1] - b[i + 1]) + std::abs(a[i + 2] - b[i + 2]);
+        if (d > ignore_threshold) {
+            total += d;
+        }
+    }
+    return total;
+}
+
+#if defined(PIXEL_KERNEL_X86)
+
+PIXEL_KERNEL_TARGET("sse4.1")
+inline __m128i pick(__m128i v0, __m128i v1, __m128i v2, __m128i m0, __m128i m1, __m128i m2) {
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m0), _mm_shuffle_epi8(v1, m1)), _mm_shuffle_epi8(v2, m2));
+}
+
+// Splits 16 packed BGR pixels in three registers into one register per channel.
+PIXEL_KERNEL_TARGET("sse4.1")
+inline void deinterleave(__m128i v0, __m128i v1, __m128i v2, __m128i &c0, __m128i &c1, __m128i &c2) {
+    c0 = pick(
+        v0,
+        v1,
+        v2,
+        _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13));
+    c1 = pick(
+        v0,
+        v1,
+        v2,
+        _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14));
+    c2 = pick(
+        v0,
+        v1,
+        v2,
+        _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15));
+}
+
+PIXEL_KERNEL_TARGET("sse4.1")
+inline __m128i absoluteDifference(const uint8_t *a, const uint8_t *b) {
+    const auto va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+    const auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+    return _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+}
+
+PIXEL_KERNEL_TARGET("sse4.1")
+inline uint64_t differenceRowSSE4(const uint8_t *a, const uint8_t *b, int width, int ignore_threshold) {
+    const auto zero = _mm_setzero_si128();
+    const auto ones = _mm_set1_epi16(1);
+    const auto threshold = _mm_set1_epi16(static_cast<int16_t>(std::min(ignore_threshold, 765)));
+    auto sums = _mm_setzero_si128();  // At most 16 * 765 per pixel group and lane, so a row fits in 32 bits.
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const auto *pa = a + x * 3;
+        const auto *pb = b + x * 3;
+        __m128i c0, c1, c2;
+        deinterleave(
+            absoluteDifference(pa, pb), absoluteDifference(pa + 16, pb + 16), absoluteDifference(pa + 32, pb + 32),
+            c0, c1, c2);
+        const auto low = _mm_add_epi16(
+            _mm_add_epi16(_mm_unpacklo_epi8(c0, zero), _mm_unpacklo_epi8(c1, zero)), _mm_unpacklo_epi8(c2, zero));
+        const auto high = _mm_add_epi16(
+            _mm_add_epi16(_mm_unpackhi_epi8(c0, zero), _mm_unpackhi_epi8(c1, zero)), _mm_unpackhi_epi8(c2, zero));
+        sums = _mm_add_epi32(sums, _mm_madd_epi16(_mm_and_si128(low, _mm_cmpgt_epi16(low, threshold)), ones));
+        sums = _mm_add_epi32(sums, _mm_madd_epi16(_mm_and_si128(high, _mm_cmpgt_epi16(high, threshold)), ones));
+    }
+
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sums);
+    const uint64_t total = uint64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+    return total + differenceRowScalar(a + x * 3, b + x * 3, width - x, ignore_threshold);
+}
+
+PIXEL_KERNEL_TARGET("avx2")
+inline uint64_t differenceRowAVX2(const uint8_t *a, const uint8_t *b, int width, int ignore_threshold) {
+    const auto ones = _mm256_set1_epi16(1);
+    const auto threshold = _mm256_set1_epi16(static_cast<int16_t>(std::min(ignore_threshold, 765)));
+    auto sums = _mm256_setzero_si256();
+
+    // The channels are split with 128-bit shuffles, which do not cross lanes, and then summed in 256-bit registers.
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const auto *pa = a + x * 3;
+        const auto *pb = b + x * 3;
+        __m128i c0, c1, c2;
+        deinterleave(
+            absoluteDifference(pa, pb), absoluteDifference(pa + 16, pb + 16), absoluteDifference(pa + 32, pb + 32),
+            c0, c1, c2);
+        const auto d = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_cvtepu8_epi16(c0), _mm256_cvtepu8_epi16(c1)), _mm256_cvtepu8_epi16(c2));
+        sums = _mm256_add_epi32(sums, _mm256_madd_epi16(_mm256_and_si256(d, _mm256_cmpgt_epi16(d, threshold)), ones));
+    }
+
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sums);
+    uint64_t total = 0;
+    for (const auto &lane : lanes) {
+        total += lane;
+    }
+    return total + differenceRowScalar(a + x * 3, b + x * 3, width - x, ignore_threshold);
+}
+
+inline bool cpuSupports(Kernel kernel) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const auto max_leaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    bool avx2 = false;
+    if (max_leaf >= 7 && os_avx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    switch (kernel) {
+        case Scalar: return true;
+        case SSE4: return sse41;
+        case AVX2: return avx2;
+        default: return false;
+    }
+}
+
+#elif defined(PIXEL_KERNEL_NEON)
+
+inline uint64_t differenceRowNEON(const uint8_t *a, const uint8_t *b, int width, int ignore_threshold) {
+    const auto threshold = vdupq_n_u16(static_cast<uint16_t>(std::min(ignore_threshold, 765)));
+    auto sums = vdupq_n_u32(0);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const auto va = vld3q_u8(a + x * 3);
+        const auto vb = vld3q_u8(b + x * 3);
+        const auto d0 = vabdq_u8(va.val[0], vb.val[0]);
+        const auto d1 = vabdq_u8(va.val[1], vb.val[1]);
+        const auto d2 = vabdq_u8(va.val[2], vb.val[2]);
+        const auto low = vaddw_u8(vaddl_u8(vget_low_u8(d0), vget_low_u8(d1)), vget_low_u8(d2));
+        const auto high = vaddw_u8(vaddl_u8(vget_high_u8(d0), vget_high_u8(d1)), vget_high_u8(d2));
+        sums = vpadalq_u16(sums, vandq_u16(low, vcgtq_u16(low, threshold)));
+        sums = vpadalq_u16(sums, vandq_u16(high, vcgtq_u16(high, threshold)));
+    }
+
+    uint32_t lanes[4];
+    vst1q_u32(lanes, sums);
+    const uint64_t total = uint64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+    return total + differenceRowScalar(a + x * 3, b + x * 3, width - x, ignore_threshold);
+}
+
+inline bool cpuSupports(Kernel kernel) { return kernel == Scalar || kernel == NEON; }
+
+#else
+
+inline bool cpuSupports(Kernel kernel) { return kernel == Scalar; }
+
+#endif
+
+inline DifferenceRowFunction differenceRowOf(Kernel kernel) {
+    switch (kernel) {
+#if defined(PIXEL_KERNEL_X86)
+        case SSE4: return differenceRowSSE4;
+        case AVX2: return differenceRowAVX2;
+#elif defined(PIXEL_KERNEL_NEON)
+        case NEON: return differenceRowNEON;
+#endif
+        default: return differenceRowScalar;
+    }
+}
+
+}  // namespace kernel_impl
+
+[[nodiscard]] inline bool supported(Kernel kernel) { return kernel_impl::cpuSupports(kernel); }
+
+// The fastest kernel that the CPU supports, detected once.
+[[nodiscard]] inline Kernel bestKernel() {
+    static const Kernel kernel = []() {
+        for (const auto &candidate : {AVX2, NEON, SSE4}) {
+            if (supported(candidate)) {
+                return candidate;
+            }
+        }
+        return Scalar;
+    }();
+    return kernel;
+}
+
+[[nodiscard]] inline std::string kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Scalar: return "scalar";
+        case SSE4: return "sse4";
+        case AVX2: return "avx2";
+        case NEON: return "neon";
+        default: return "unknown";
+    }
+}
+
+/**
+ * Sum of the per-pixel BGR absolute differences above ignore_threshold, over two images of packed BGR pixels.
+ * Rows are summed in order, and the sum stops after the row where it reaches bound. So the result is exact
+ * if it is less than bound, and is some value not less than bound otherwise.
+ */
+[[nodiscard]] inline uint64_t difference(
+    const uint8_t *a,
+    size_t a_step,
+    const uint8_t *b,
+    size_t b_step,
+    int width,
+    int height,
+    int ignore_threshold,
+    uint64_t bound = std::numeric_limits<uint64_t>::max(),
+    Kernel kernel = bestKernel()) {
+    const auto difference_row = kernel_impl::differenceRowOf(kernel);
+    uint64_t total = 0;
+    for (int y = 0; y < height; y++) {
+        total += difference_row(a + y * a_step, b + y * b_step, width, ignore_threshold);
+        if (total >= bound) {
+            break;
+        }
+    }
+    return total;
+}
+
+}  // namespace uma::pixel_kernel
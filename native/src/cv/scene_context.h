@@ -1,12 +1,21 @@
 #pragma once
 
+#include "cv/frame.h"
+#include "util/event_util.h"
+
 namespace uma::distributor {
 
 class SceneContext {
 public:
     virtual ~SceneContext() = default;
-    virtual void update(const Frame &input) = 0;
+    virtual void update(const event_util::Shared<Frame> &input) = 0;
     [[nodiscard]] virtual bool met() const = 0;
+
+    // True if an identical frame would change nothing, so the distributor may skip it.
+    [[nodiscard]] virtual bool settled() const { return false; }
+
+    // Called when no frame follows, as at the end of a video. What waits for the next frames should end here.
+    virtual void flush() {}
 };
 
 }  // namespace uma::distributor
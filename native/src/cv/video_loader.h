@@ -1,53 +1,252 @@
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Weverything"
 #include <opencv2/opencv.hpp>
 #pragma clang diagnostic ppop
 
+#include "cv/frame_pool.h"
+
 namespace uma::video {
 
+namespace video_impl {
+
+struct DecodedFrame {
+    cv::Mat mat;
+    int64 timestamp;  // From the start of its file.
+};
+
+/**
+ * Decoded frames of one file, in order. Bounded, so a decoder ahead of the merge waits instead of filling memory.
+ * Closed by the decoder when the file ends, with the length of the file or the error that stopped it.
+ */
+class DecodedFrameQueue {
+public:
+    explicit DecodedFrameQueue(size_t capacity)
+        : capacity(capacity) {}
+
+    // False if the queue was cancelled, and the decoder should stop.
+    bool push(DecodedFrame &&frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return frames.size() < capacity || cancelled; });
+        if (cancelled) {
+            return false;
+        }
+        frames.push_back(std::move(frame));
+        condition.notify_all();
+        return true;
+    }
+
+    // Null once the file ended and every frame of it was taken.
+    std::optional<DecodedFrame> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return !frames.empty() || closed; });
+        if (frames.empty()) {
+            return std::nullopt;
+        }
+        auto frame = std::move(frames.front());
+        frames.pop_front();
+        condition.notify_all();
+        return frame;
+    }
+
+    void close(int64 length, const std::exception_ptr &error = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        length_ = length;
+        error_ = error;
+        closed = true;
+        condition.notify_all();
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+        condition.notify_all();
+    }
+
+    // Valid after pop returned null.
+    [[nodiscard]] int64 length() const { return length_; }
+    [[nodiscard]] const std::exception_ptr &error() const { return error_; }
+
+private:
+    const size_t capacity;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<DecodedFrame> frames;
+    int64 length_ = 0;
+    std::exception_ptr error_;
+    bool closed = false;
+    bool cancelled = false;
+};
+
+}  // namespace video_impl
+
+struct VideoLoaderConfig {
+    // Files decoded at once. A file is decoded by a single thread, so this parallelizes across files.
+    int decoder_threads = std::clamp<int>(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1, 4);
+    size_t prefetch_frames = 8;  // Per file being decoded.
+    double target_fps = 0.0;  // Zero keeps every frame.
+};
+
 class VideoLoader {
 public:
-    explicit VideoLoader(const event_util::Sender<cv::Mat, cv::Size, uint64> &on_frame_captured)
-        : on_frame_captured(on_frame_captured) {
+    explicit VideoLoader(
+        const event_util::Sender<cv::Mat, cv::Size, uint64> &on_frame_captured,
+        const event_util::Sender<> &on_batch_ended = nullptr,
+        const VideoLoaderConfig &config = {})
+        : on_frame_captured(on_frame_captured)
+        , on_batch_ended(on_batch_ended)
+        , config(config) {
         std::filesystem::create_directories("./temp");
     }
 
+    // Frames are sent as fast as the receiver accepts them. Time-based conditions follow the frame timestamps.
+    // Files are decoded ahead on the decoder threads, and merged here in order, each file starting
+    // where the previous one ended, so the timestamps increase as if the files were a single video.
+    // The end of the batch is sent after the last frame, since no later frame reaches the deadlines of the stages.
     [[maybe_unused]] void runBatch(const std::vector<std::filesystem::path> &files) const {
-        int64 ts = 0;
-        for (const auto &path : files) {
-            ts += run(path, ts);
+        std::vector<std::shared_ptr<video_impl::DecodedFrameQueue>> queues;
+        for (size_t i = 0; i < files.size(); i++) {
+            queues.push_back(std::make_shared<video_impl::DecodedFrameQueue>(config.prefetch_frames));
+        }
+
+        // A decoder starts a file only within the window of the file being merged, which bounds the frames held.
+        const auto window = static_cast<size_t>(std::max(config.decoder_threads, 1));
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t next_file = 0;
+        size_t merging_file = 0;
+        bool cancelled = false;
+
+        std::vector<std::thread> decoders;
+        for (size_t t = 0; t < std::min(window, files.size()); t++) {
+            decoders.emplace_back([&]() {
+                while (true) {
+                    size_t index;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        condition.wait(lock, [&]() { return next_file < merging_file + window || cancelled; });
+                        if (cancelled || next_file >= files.size()) {
+                            return;
+                        }
+                        index = next_file++;
+                    }
+                    auto &queue = *queues[index];
+                    try {
+                        const auto length =
+                            decode(files[index], [&queue](auto &&frame) { return queue.push(std::move(frame)); });
+                        queue.close(length);
+                    } catch (...) {
+                        queue.close(0, std::current_exception());
+                    }
+                }
+            });
+        }
+
+        const auto stop = [&]() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cancelled = true;
+            }
+            condition.notify_all();
+            for (const auto &queue : queues) {
+                queue->cancel();
+            }
+            for (auto &decoder : decoders) {
+                decoder.join();
+            }
+        };
+
+        try {
+            int64 head_ts = 0;
+            for (size_t i = 0; i < files.size(); i++) {
+                auto &queue = *queues[i];
+                while (auto frame = queue.pop()) {
+                    on_frame_captured->send(frame->mat, frame->mat.size(), head_ts + frame->timestamp);
+                }
+                if (queue.error()) {
+                    std::rethrow_exception(queue.error());
+                }
+                head_ts += queue.length();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    merging_file = i + 1;
+                }
+                condition.notify_all();
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+        stop();
+        if (on_batch_ended) {
+            on_batch_ended->send();
         }
     }
 
+    // Decodes a single file on the calling thread.
     [[nodiscard]] int64 run(const std::filesystem::path &path, int64 head_ts = 0) const {
+        return decode(path, [&](video_impl::DecodedFrame &&frame) {
+            on_frame_captured->send(frame.mat, frame.mat.size(), head_ts + frame.timestamp);
+            return true;
+        });
+    }
+
+private:
+    // Sinks the frames of the file until the sink returns false, and returns the length of the file.
+    // With a target fps, skipped frames are only grabbed, not converted, so they cost little more than demuxing.
+    template<typename Sink>
+    int64 decode(const std::filesystem::path &path, Sink &&sink) const {
         vlog_info(path.string());
         cv::VideoCapture cap;
         if (!cap.open(path.generic_string())) {
             throw std::runtime_error((std::ostringstream() << "Failed to open: " << path.generic_string()).str());
         }
 
+        const int64 interval = config.target_fps > 0 ? std::llround(1000.0 / config.target_fps) : 0;
+        std::optional<int64> next_kept_ts;
         int64 last_ts = 0;
         for (int i = 0;; i++) {
-            cv::Mat mat;
-            if (!cap.read(mat) || mat.empty()) {
+            if (!cap.grab()) {
                 break;
             }
             const auto ts = std::llround(cap.get(cv::CAP_PROP_POS_MSEC));
             if (i != 0 && ts <= 0) {
                 break;
             }
+            last_ts = std::max(last_ts, static_cast<int64>(ts));
+            if (next_kept_ts && ts < next_kept_ts.value()) {
+                continue;
+            }
+
+            // Decoded into the frame pool, since every frame is released as soon as the pipeline has converted it.
+            cv::Mat mat = FramePool::instance().output();
+            if (!cap.retrieve(mat) || mat.empty()) {
+                break;
+            }
 
             //            save(i, ts, mat);
 
-            last_ts = std::max(last_ts, ts);
-            on_frame_captured->send(mat, mat.size(), std::llround(ts + head_ts));
+            next_kept_ts = ts + interval;
+            if (!sink(video_impl::DecodedFrame{mat, ts})) {
+                break;
+            }
         }
         return last_ts;
     }
 
-private:
     void save(int index, uint64 ts, const cv::Mat &mat) const {
         std::ostringstream stream;
         stream << "./temp/source_frames/" << std::setw(5) << std::setfill('0') << index << "_" << ts << ".png";
@@ -56,6 +255,8 @@ private:
     }
 
     const event_util::Sender<cv::Mat, cv::Size, uint64> on_frame_captured{};
+    const event_util::Sender<> on_batch_ended;
+    const VideoLoaderConfig config;
 };
 
 }  // namespace uma::video
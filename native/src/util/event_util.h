@@ -1,20 +1,62 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <utility>
 
+#include <eventpp/callbacklist.h>
 #include <eventpp/eventdispatcher.h>
 #include <eventpp/eventqueue.h>
 
+#include "util/json_util.h"
 #include "util/logger_util.h"
+#include "util/metrics_util.h"
 #include "util/thread_util.h"
 
 namespace uma::event_util {
 
 enum QueueLimitMode {
     NoLimit,
-    Discard,
+    Discard,  // Drops the newest event when full.
     Block,
+    DropOldest,  // Drops the oldest pending event when full. With capacity 1, this is a latest-value mailbox.
+    Coalesce,  // Only the newest pending event of each key is dispatched. Events without a key are never dropped.
 };
+EXTENDED_JSON_TYPE_ENUM(QueueLimitMode, NoLimit, Discard, Block, DropOldest, Coalesce)
+
+enum QueueBackend {
+    EventQueueBackend,  // eventpp::EventQueue, guarded by a mutex. Unbounded storage.
+    RingBufferBackend,  // Lock-free ring with preallocated slots. NoLimit is treated as Block.
+};
+
+struct QueueConfig {
+    QueueLimitMode mode;
+    int capacity;
+
+    EXTENDED_JSON_TYPE_NDC(QueueConfig, mode, capacity);
+};
+
+template<typename... Args>
+using CoalesceKey = std::function<std::optional<int>(const Args &...)>;
+
+constexpr int default_queue_limit_size = 3;
+
+/**
+ * Immutable payload handle for events delivered to several listeners or across several hops.
+ * Copying the handle never copies the payload.
+ */
+template<typename T>
+using Shared = std::shared_ptr<const T>;
+
+template<typename T, typename... Args>
+inline Shared<T> makeShared(Args &&...args) {
+    return std::make_shared<const T>(std::forward<Args>(args)...);
+}
 
 namespace event_util_impl {
 
@@ -35,6 +77,7 @@ class SenderBase {
 public:
     virtual ~SenderBase() = default;
 
+    // Arguments are sinks. Pass rvalues to move them into the connection; listeners receive them by const reference.
     virtual void send(Args... args) = 0;
 
     template<
@@ -60,7 +103,7 @@ class ListenerInterface {
 public:
     virtual ~ListenerInterface() = default;
 
-    virtual void listen(const std::function<void(Args...)> &method) = 0;
+    virtual void listen(const std::function<void(const Args &...)> &method) = 0;
 };
 
 class EventProcessorInterface {
@@ -71,6 +114,8 @@ public:
 
     virtual void processIf(const std::function<bool()> &predicate) = 0;
     virtual void processOne() = 0;
+
+    [[nodiscard]] virtual std::shared_ptr<const metrics_util::ConnectionMetrics> metrics() const = 0;
 };
 
 template<typename... Args>
@@ -83,79 +128,427 @@ public:
 
     void send(Args... args) override { connection.dispatch(0, args...); }
 
-    void listen(const std::function<void(Args...)> &method) override { connection.appendListener(0, method); }
+    void listen(const std::function<void(const Args &...)> &method) override { connection.appendListener(0, method); }
 
 private:
-    eventpp::EventDispatcher<int, void(Args...)> connection;
+    eventpp::EventDispatcher<int, void(const Args &...)> connection;
 };
 
 template<typename... Args>
 class QueuedConnectionImpl : public ConnectionInterface<Args...>, public EventProcessorInterface {
 public:
-    explicit QueuedConnectionImpl(QueueLimitMode queue_limit_mode)
-        : queue_limit_mode(queue_limit_mode)
-        , notifier(nullptr)
-        , id(0) {}
-
-    QueuedConnectionImpl(QueueLimitMode queue_limit_mode, const std::shared_ptr<SenderBase<int>> &notifier, int id)
-        : queue_limit_mode(queue_limit_mode)
+    explicit QueuedConnectionImpl(const QueueConfig &queue_config, const CoalesceKey<Args...> &coalesce_key = nullptr)
+        : QueuedConnectionImpl(queue_config, nullptr, 0, coalesce_key) {}
+
+    QueuedConnectionImpl(
+        const QueueConfig &queue_config,
+        const std::shared_ptr<SenderBase<int>> &notifier,
+        int id,
+        const CoalesceKey<Args...> &coalesce_key = nullptr)
+        : queue_limit_mode(queue_config.mode)
+        , queue_limit_size(queue_config.capacity)
+        , coalesce_key(coalesce_key)
         , notifier(notifier)
-        , id(id) {}
+        , id(id) {
+        assert_(queue_limit_mode != DropOldest);  // Use RingBufferConnectionImpl.
+        assert_(queue_limit_mode != Coalesce || coalesce_key);
+        connection.appendListener(0, [this](const EventTag &tag, const Args &...args) {
+            if (isStale(tag.key)) {
+                connection_metrics->dropped();
+                return;
+            }
+            connection_metrics->dispatched(tag.enqueued_at);
+            listeners(args...);
+        });
+    }
 
     ~QueuedConnectionImpl() override = default;
 
     void send(Args... args) override {
-        if (!ready()) {
-            switch (queue_limit_mode) {
-                case Discard: return;
-                case Block: waitUntilReady(); break;
-                case NoLimit: break;
-                default: throw std::logic_error("Unimplemented.");
+        const auto key = (queue_limit_mode == Coalesce) ? coalesce_key(args...) : std::nullopt;
+        {
+            // The capacity check and the enqueue must be atomic, or concurrent senders can overfill the queue.
+            std::unique_lock<std::mutex> lock(capacity_mutex);
+            if (!ready()) {
+                switch (queue_limit_mode) {
+                    case Discard: connection_metrics->dropped(); return;
+                    case Block: capacity_condition.wait(lock, [this]() { return ready(); }); break;
+                    case NoLimit:
+                    case Coalesce: break;
+                    default: throw std::logic_error("Unimplemented.");
+                }
+            }
+            if (key) {
+                pending_keys[key.value()]++;
             }
+            connection.enqueue(0, EventTag{key, metrics_util::steadyNanoseconds()}, std::move(args)...);
+            connection_metrics->enqueued(connection.size());
         }
 
-        // TODO: This should be synchronized.
-        connection.enqueue(0, args...);
         if (notifier != nullptr) {
             notifier->send(id);
         }
     }
 
-    void listen(const std::function<void(Args...)> &method) override { connection.appendListener(0, method); }
+    void listen(const std::function<void(const Args &...)> &method) override { listeners.append(method); }
 
     void waitFor(int milliseconds) const override { connection.waitFor(std::chrono::milliseconds(milliseconds)); }
 
-    void processIf(const std::function<bool()> &predicate) override { connection.processIf(predicate); }
+    void processIf(const std::function<bool()> &predicate) override {
+        connection.processIf(predicate);
+        notifyCapacity();
+    }
 
     void processOne() override {
         while (!connection.processOne()) {
         }
+        notifyCapacity();
+    }
+
+    [[nodiscard]] std::shared_ptr<const metrics_util::ConnectionMetrics> metrics() const override {
+        return connection_metrics;
     }
 
 private:
-    [[nodiscard]] bool ready() const { return connection.size() < queue_limit_size; }
+    struct EventTag {
+        std::optional<int> key;
+        uint64_t enqueued_at;
+    };
+
+    [[nodiscard]] bool ready() const { return connection.size() < static_cast<size_t>(queue_limit_size); }
+
+    // In Coalesce mode, an event is stale when a newer event with the same key is still pending.
+    bool isStale(const std::optional<int> &key) {
+        if (!key) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(capacity_mutex);
+        return --pending_keys[key.value()] > 0;
+    }
 
-    void waitUntilReady() {
-        while (!ready()) {
-            waitFor(10);
+    void notifyCapacity() {
+        if (queue_limit_mode != Block) {
+            return;
         }
+        {
+            // Taking the lock orders this notification after a sender that is about to wait.
+            std::lock_guard<std::mutex> lock(capacity_mutex);
+        }
+        capacity_condition.notify_one();
     }
 
     const QueueLimitMode queue_limit_mode;
-    const size_t queue_limit_size = 3;
+    const int queue_limit_size;
+    const CoalesceKey<Args...> coalesce_key;
+
+    std::mutex capacity_mutex;
+    std::condition_variable capacity_condition;
+    std::unordered_map<int, int> pending_keys;
 
-    eventpp::EventQueue<int, void(Args...)> connection;
+    eventpp::EventQueue<int, void(const EventTag &, const Args &...)> connection;
+    eventpp::CallbackList<void(const Args &...)> listeners;
+    const std::shared_ptr<metrics_util::ConnectionMetrics> connection_metrics =
+        std::make_shared<metrics_util::ConnectionMetrics>();
     const std::shared_ptr<SenderBase<int>> notifier;
     const int id;
 };
 
+template<typename... Args>
+class RingBufferConnectionImpl : public ConnectionInterface<Args...>, public EventProcessorInterface {
+public:
+    explicit RingBufferConnectionImpl(const QueueConfig &queue_config)
+        : RingBufferConnectionImpl(queue_config, nullptr, 0) {}
+
+    RingBufferConnectionImpl(const QueueConfig &queue_config, const std::shared_ptr<SenderBase<int>> &notifier, int id)
+        : queue_limit_mode(queue_config.mode)
+        , buffer(queue_config.capacity)
+        , notifier(notifier)
+        , id(id) {
+        assert_(queue_limit_mode != Coalesce);  // Use QueuedConnectionImpl.
+    }
+
+    ~RingBufferConnectionImpl() override = default;
+
+    void send(Args... args) override {
+        Event item{metrics_util::steadyNanoseconds(), {std::move(args)...}};
+        if (!buffer.tryPush(std::move(item))) {
+            switch (queue_limit_mode) {
+                case Discard: connection_metrics->dropped(); return;
+                case Block:
+                case NoLimit: waitUntilPushed(std::move(item)); break;
+                case DropOldest: dropOldestUntilPushed(std::move(item)); break;
+                default: throw std::logic_error("Unimplemented.");
+            }
+        }
+        connection_metrics->enqueued(buffer.size());
+
+        if (notifier != nullptr) {
+            notifier->send(id);
+        }
+    }
+
+    void listen(const std::function<void(const Args &...)> &method) override { listeners.append(method); }
+
+    void waitFor(int milliseconds) const override {
+        // The ring has no wakeup primitive. Runners are woken through the notifier, so this is only a fallback.
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+        while (buffer.empty() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+    }
+
+    void processIf(const std::function<bool()> &predicate) override {
+        while (predicate() && !buffer.empty()) {
+            processOne();
+        }
+    }
+
+    void processOne() override {
+        // Each notification stands for one position in the ring, in push order. If the event at that position
+        // has been dropped by DropOldest, the oldest remaining event is dispatched instead, so a mailbox that is
+        // always overwritten still delivers. The notifications of events dispatched early then do nothing.
+        const auto position = next_position++;
+        if (position < dispatched_until) {
+            return;
+        }
+        while (true) {
+            const auto target = std::max(position, buffer.headPosition());
+            const auto item = buffer.tryPopAt(target);
+            if (item) {
+                dispatched_until = target + 1;
+                notifyCapacity();
+                dispatch(item.value());
+                return;
+            }
+        }
+    }
+
+    [[nodiscard]] std::shared_ptr<const metrics_util::ConnectionMetrics> metrics() const override {
+        return connection_metrics;
+    }
+
+private:
+    struct Event {
+        uint64_t enqueued_at;
+        std::tuple<Args...> args;
+    };
+
+    void waitUntilPushed(Event &&item) {
+        std::unique_lock<std::mutex> lock(capacity_mutex);
+        waiting_senders.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        capacity_condition.wait(lock, [&]() { return buffer.tryPush(std::move(item)); });
+        waiting_senders.fetch_sub(1);
+    }
+
+    void dropOldestUntilPushed(Event &&item) {
+        while (!buffer.tryPush(std::move(item))) {
+            if (buffer.tryPop()) {  // May fail if the consumer has just taken it, then retry.
+                connection_metrics->dropped();
+            }
+        }
+    }
+
+    void notifyCapacity() {
+        // The fast path stays lock-free. The mutex is touched only while a sender is blocked.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_senders.load() == 0) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(capacity_mutex);
+        }
+        capacity_condition.notify_all();
+    }
+
+    void dispatch(const Event &item) {
+        connection_metrics->dispatched(item.enqueued_at);
+        std::apply([this](const auto &...args) { listeners(args...); }, item.args);
+    }
+
+    const QueueLimitMode queue_limit_mode;
+
+    thread_util::RingBuffer<Event> buffer;
+    eventpp::CallbackList<void(const Args &...)> listeners;
+    size_t next_position = 0;  // Only touched by the consumer.
+    size_t dispatched_until = 0;  // Only touched by the consumer.
+    const std::shared_ptr<metrics_util::ConnectionMetrics> connection_metrics =
+        std::make_shared<metrics_util::ConnectionMetrics>();
+
+    std::atomic_int waiting_senders = 0;
+    std::mutex capacity_mutex;
+    std::condition_variable capacity_condition;
+    const std::shared_ptr<SenderBase<int>> notifier;
+    const int id;
+};
+
+/**
+ * Wakes a runner as soon as one of its connections has an event, instead of polling.
+ * Indices are taken in the order they were sent, which keeps the order of events across connections.
+ */
+class EventNotifier : public SenderBase<int> {
+public:
+    void send(int index) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(index);
+        }
+        condition.notify_one();
+    }
+
+    // Blocks until an index is available. Returns nullopt once interrupted.
+    [[nodiscard]] std::optional<int> take() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return interrupted || !pending.empty(); });
+        if (interrupted) {
+            return std::nullopt;
+        }
+        const auto index = pending.front();
+        pending.pop_front();
+        return index;
+    }
+
+    void interrupt() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            interrupted = true;
+        }
+        condition.notify_all();
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        interrupted = false;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<int> pending;
+    bool interrupted = false;
+};
+
+/**
+ * Distributes processor indices to a fixed set of workers.
+ * Each worker owns a deque. Notifications sent from a worker go to its own deque, the others are spread round-robin,
+ * and a worker whose deque is empty steals from the back of the others.
+ */
+class WorkStealingScheduler : public SenderBase<int> {
+public:
+    explicit WorkStealingScheduler(size_t worker_count)
+        : queues(worker_count) {
+        assert_(worker_count > 0);
+    }
+
+    void send(int index) override {
+        const auto worker = (current_scheduler == this) ? current_worker
+                                                        : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            queues[worker].tasks.push_back(index);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+        }
+        condition.notify_one();
+    }
+
+    // Blocks until an index is available. Returns nullopt once interrupted.
+    [[nodiscard]] std::optional<int> take(size_t worker) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return interrupted || pending > 0; });
+            if (interrupted) {
+                return std::nullopt;
+            }
+            pending--;  // Reserves one of the queued tasks.
+        }
+        while (true) {
+            if (const auto index = popFront(worker)) {
+                return index;
+            }
+            for (size_t i = 1; i < queues.size(); i++) {
+                if (const auto index = popBack((worker + i) % queues.size())) {
+                    return index;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Must be called from the worker thread before take().
+    void bindCurrentThread(size_t worker) {
+        current_scheduler = this;
+        current_worker = worker;
+    }
+
+    void interrupt() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            interrupted = true;
+        }
+        condition.notify_all();
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        interrupted = false;
+    }
+
+    [[nodiscard]] size_t workerCount() const { return queues.size(); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    std::optional<int> popFront(size_t worker) {
+        auto &queue = queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return std::nullopt;
+        }
+        const auto index = queue.tasks.front();
+        queue.tasks.pop_front();
+        return index;
+    }
+
+    std::optional<int> popBack(size_t worker) {
+        auto &queue = queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return std::nullopt;
+        }
+        const auto index = queue.tasks.back();
+        queue.tasks.pop_back();
+        return index;
+    }
+
+    std::vector<WorkerQueue> queues;
+    std::atomic_size_t next_queue = 0;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t pending = 0;
+    bool interrupted = false;
+
+    static inline thread_local const WorkStealingScheduler *current_scheduler = nullptr;
+    static inline thread_local size_t current_worker = 0;
+};
+
 class EventRunnerThread : public thread_util::ThreadBase {
 public:
     EventRunnerThread(
-        const std::shared_ptr<EventProcessorInterface> &processor,
+        const std::function<std::optional<int>()> &take,
+        const std::function<void()> &on_interrupt,
+        const std::function<void(int)> &dispatch,
         const std::function<void()> &detach,
         const std::string &name)
-        : processor(processor)
+        : take(take)
+        , on_interrupt(on_interrupt)
+        , dispatch(dispatch)
         , detach(detach)
         , name(name) {}
 
@@ -164,8 +557,11 @@ protected:
         log_debug("start {}", name);
 
         while (isRunning()) {
-            processor->waitFor(loopTimeoutMilliseconds);
-            processor->processIf([&]() { return isRunning(); });
+            const auto index = take();
+            if (!index) {
+                break;
+            }
+            dispatch(index.value());
         }
 
         if (detach) {
@@ -175,13 +571,40 @@ protected:
         log_debug("finished {}", name);
     }
 
+    void interrupt() override { on_interrupt(); }
+
 private:
     const std::string name;
-    const std::shared_ptr<EventProcessorInterface> processor;
+    const std::function<std::optional<int>()> take;
+    const std::function<void()> on_interrupt;
+    const std::function<void(int)> dispatch;
     const std::function<void(void)> detach;
-    const int loopTimeoutMilliseconds = 8;
 };
 
+/**
+ * Policies that only one backend implements override the requested backend:
+ * DropOldest always uses the ring, and Coalesce always uses the event queue.
+ */
+template<typename... Args>
+std::shared_ptr<ConnectionInterface<Args...>> makeRunnerConnection(
+    const QueueConfig &queue_config,
+    QueueBackend queue_backend,
+    const CoalesceKey<Args...> &coalesce_key,
+    const std::shared_ptr<SenderBase<int>> &notifier,
+    int id,
+    std::shared_ptr<EventProcessorInterface> &processor) {
+    const bool use_ring_buffer =
+        (queue_config.mode == DropOldest) || (queue_backend == RingBufferBackend && queue_config.mode != Coalesce);
+    if (use_ring_buffer) {
+        const auto connection = std::make_shared<RingBufferConnectionImpl<Args...>>(queue_config, notifier, id);
+        processor = connection;
+        return connection;
+    }
+    const auto connection = std::make_shared<QueuedConnectionImpl<Args...>>(queue_config, notifier, id, coalesce_key);
+    processor = connection;
+    return connection;
+}
+
 class EventRunnerInterface {
 public:
     virtual ~EventRunnerInterface() = default;
@@ -194,29 +617,43 @@ class SingleThreadMultiEventRunnerImpl : public EventRunnerInterface {
 public:
     SingleThreadMultiEventRunnerImpl(
         QueueLimitMode queue_limit_mode, const std::function<void()> &finalizer, const std::string &name)
-        : queue_limit_mode(queue_limit_mode)
-        , notifier(std::make_shared<QueuedConnectionImpl<int>>(QueueLimitMode::NoLimit))
+        : default_queue_config({queue_limit_mode, default_queue_limit_size})
+        , notifier(std::make_shared<EventNotifier>())
         , finalizer(finalizer)
-        , name(name) {
-        notifier->listen([this](const int &index) {
-            assert_(isRunning());
-            processors[index]->processOne();
-        });
+        , name(name) {}
+
+    template<typename... Args>
+    std::shared_ptr<ConnectionInterface<Args...>> makeConnection(QueueBackend queue_backend = EventQueueBackend) {
+        return makeConnection<Args...>(default_queue_config, queue_backend);
     }
 
     template<typename... Args>
-    std::shared_ptr<ConnectionInterface<Args...>> makeConnection() {
+    std::shared_ptr<ConnectionInterface<Args...>> makeConnection(
+        const QueueConfig &queue_config,
+        QueueBackend queue_backend = EventQueueBackend,
+        const std::common_type_t<CoalesceKey<Args...>> &coalesce_key = nullptr) {  // Non-deduced, accepts lambdas.
         assert_(!isRunning());
-        auto connection = std::make_shared<QueuedConnectionImpl<Args...>>(
-            queue_limit_mode, notifier, static_cast<int>(processors.size()));
-        processors.emplace_back(connection);
-        return connection;
+        const auto id = static_cast<int>(processors.size());
+        return makeRunnerConnection<Args...>(
+            queue_config, queue_backend, coalesce_key, notifier, id, processors.emplace_back());
     }
 
     void start() override {
         vlog_debug(isRunning());
         assert_(!isRunning());
-        runner = std::make_shared<EventRunnerThread>(notifier, finalizer, name);
+        notifier->reset();
+        runner_metrics->started(1);
+        runner = std::make_shared<EventRunnerThread>(
+            [this]() { return notifier->take(); },
+            [this]() { notifier->interrupt(); },
+            [this](int index) {
+                assert_(isRunning());
+                const auto began_at = metrics_util::steadyNanoseconds();
+                processors[index]->processOne();
+                runner_metrics->dispatched(began_at);
+            },
+            finalizer,
+            name);
         runner->start();
     }
 
@@ -231,18 +668,323 @@ public:
 
     [[nodiscard]] bool isRunning() const override { return runner != nullptr; }
 
+    [[nodiscard]] std::shared_ptr<const metrics_util::RunnerMetrics> metrics() const { return runner_metrics; }
+
 private:
-    const std::shared_ptr<QueuedConnectionImpl<int>> notifier;
+    const std::shared_ptr<EventNotifier> notifier;
     const std::function<void(void)> finalizer;
     const std::string name;
-    const QueueLimitMode queue_limit_mode;
+    const QueueConfig default_queue_config;
+    const std::shared_ptr<metrics_util::RunnerMetrics> runner_metrics = std::make_shared<metrics_util::RunnerMetrics>();
 
     std::vector<std::shared_ptr<EventProcessorInterface>> processors;
     std::shared_ptr<EventRunnerThread> runner;
 };
 
+/**
+ * Runs connections on a fixed number of worker threads.
+ * Events of a connection made by makeConnection are still dispatched one at a time, in order, on any worker.
+ * Events of a connection made by makeReentrantConnection are dispatched concurrently, so its listeners must be
+ * safe to call from several threads at once.
+ */
+class PoolRunnerImpl : public EventRunnerInterface {
+public:
+    PoolRunnerImpl(
+        size_t thread_count,
+        QueueLimitMode queue_limit_mode,
+        const std::function<void()> &finalizer,
+        const std::string &name)
+        : scheduler(std::make_shared<WorkStealingScheduler>(thread_count))
+        , finalizer(finalizer)
+        , name(name)
+        , default_queue_config({queue_limit_mode, default_queue_limit_size}) {}
+
+    template<typename... Args>
+    std::shared_ptr<ConnectionInterface<Args...>> makeConnection(QueueBackend queue_backend = EventQueueBackend) {
+        return makeConnection<Args...>(default_queue_config, queue_backend);
+    }
+
+    template<typename... Args>
+    std::shared_ptr<ConnectionInterface<Args...>> makeConnection(
+        const QueueConfig &queue_config,
+        QueueBackend queue_backend = EventQueueBackend,
+        const std::common_type_t<CoalesceKey<Args...>> &coalesce_key = nullptr) {  // Non-deduced, accepts lambdas.
+        return addProcessor<Args...>(queue_config, queue_backend, coalesce_key, false);
+    }
+
+    // The ring buffer backend pops by position from a single consumer, so reentrant connections always use the
+    // event queue, and DropOldest is not available.
+    template<typename... Args>
+    std::shared_ptr<ConnectionInterface<Args...>> makeReentrantConnection() {
+        return makeReentrantConnection<Args...>(default_queue_config);
+    }
+
+    template<typename... Args>
+    std::shared_ptr<ConnectionInterface<Args...>> makeReentrantConnection(
+        const QueueConfig &queue_config,
+        const std::common_type_t<CoalesceKey<Args...>> &coalesce_key = nullptr) {  // Non-deduced, accepts lambdas.
+        assert_(queue_config.mode != DropOldest);
+        return addProcessor<Args...>(queue_config, EventQueueBackend, coalesce_key, true);
+    }
+
+    void start() override {
+        vlog_debug(isRunning(), scheduler->workerCount());
+        assert_(!isRunning());
+        scheduler->reset();
+        runner_metrics->started(scheduler->workerCount());
+        for (size_t i = 0; i < scheduler->workerCount(); i++) {
+            const auto worker = std::make_shared<EventRunnerThread>(
+                [this, i]() {
+                    scheduler->bindCurrentThread(i);
+                    return scheduler->take(i);
+                },
+                [this]() { scheduler->interrupt(); },
+                [this](int index) {
+                    assert_(isRunning());
+                    const auto began_at = metrics_util::steadyNanoseconds();
+                    dispatch(*slots[index]);
+                    runner_metrics->dispatched(began_at);
+                },
+                finalizer,
+                name + "-" + std::to_string(i));
+            workers.emplace_back(worker);
+            worker->start();
+        }
+    }
+
+    void join() override {
+        vlog_debug(isRunning());
+        for (const auto &worker : workers) {
+            worker->join();
+        }
+        workers.clear();
+    }
+
+    [[nodiscard]] bool isRunning() const override { return !workers.empty(); }
+
+    [[nodiscard]] std::shared_ptr<const metrics_util::RunnerMetrics> metrics() const { return runner_metrics; }
+
+private:
+    struct ProcessorSlot {
+        std::shared_ptr<EventProcessorInterface> processor;
+        bool reentrant;
+
+        // Serializes non-reentrant processors. While one worker is dispatching, others only count their events,
+        // and that worker processes them before it releases the slot.
+        std::mutex mutex;
+        bool active = false;
+        int deferred = 0;
+    };
+
+    template<typename... Args>
+    std::shared_ptr<ConnectionInterface<Args...>> addProcessor(
+        const QueueConfig &queue_config,
+        QueueBackend queue_backend,
+        const CoalesceKey<Args...> &coalesce_key,
+        bool reentrant) {
+        assert_(!isRunning());
+        const auto id = static_cast<int>(slots.size());
+        auto &slot = slots.emplace_back(std::make_unique<ProcessorSlot>());
+        slot->reentrant = reentrant;
+        return makeRunnerConnection<Args...>(queue_config, queue_backend, coalesce_key, scheduler, id, slot->processor);
+    }
+
+    static void dispatch(ProcessorSlot &slot) {
+        if (slot.reentrant) {
+            slot.processor->processOne();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            if (slot.active) {
+                slot.deferred++;
+                return;
+            }
+            slot.active = true;
+        }
+        while (true) {
+            slot.processor->processOne();
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            if (slot.deferred == 0) {
+                slot.active = false;
+                return;
+            }
+            slot.deferred--;
+        }
+    }
+
+    const std::shared_ptr<WorkStealingScheduler> scheduler;
+    const std::function<void(void)> finalizer;
+    const std::string name;
+    const QueueConfig default_queue_config;
+
+    const std::shared_ptr<metrics_util::RunnerMetrics> runner_metrics = std::make_shared<metrics_util::RunnerMetrics>();
+
+    std::vector<std::unique_ptr<ProcessorSlot>> slots;
+    std::vector<std::shared_ptr<EventRunnerThread>> workers;
+};
+
+using TimerId = uint64_t;
+
+/**
+ * Hashed timer wheel served by one thread. Scheduling and canceling are O(1), and no thread is created per timer.
+ * On expiry, the timer id is sent to the target, which should be a connection of the runner that owns the timer,
+ * so the expiry is handled on that runner's thread.
+ * The thread sleeps while no timer is pending, and ticks at the wheel resolution otherwise.
+ */
+class TimerServiceImpl : public EventRunnerInterface {
+public:
+    explicit TimerServiceImpl(
+        std::chrono::milliseconds resolution = std::chrono::milliseconds(10), size_t slot_count = 256)
+        : resolution(resolution)
+        , slots(slot_count)
+        , origin(std::chrono::steady_clock::now()) {}
+
+    ~TimerServiceImpl() override { assert_(!isRunning()); }
+
+    TimerId schedule(std::chrono::milliseconds delay, const std::shared_ptr<SenderBase<TimerId>> &target) {
+        TimerId id;
+        bool was_idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = next_id++;
+            // Rounded up, so a timer never fires early.
+            const auto ticks = (delay.count() + resolution.count() - 1) / resolution.count();
+            const auto deadline = std::max(tickAt(std::chrono::steady_clock::now()) + ticks, processed_tick + 1);
+            const auto slot_index = static_cast<size_t>(deadline) % slots.size();
+            slots[slot_index].push_front({id, deadline, target});
+            entries.emplace(id, std::make_pair(slot_index, slots[slot_index].begin()));
+            was_idle = entries.size() == 1;
+        }
+        if (was_idle) {
+            condition.notify_one();  // The thread is sleeping without a deadline.
+        }
+        return id;
+    }
+
+    // Returns false if the timer has already expired or been canceled.
+    bool cancel(TimerId id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = entries.find(id);
+        if (it == entries.end()) {
+            return false;
+        }
+        slots[it->second.first].erase(it->second.second);
+        entries.erase(it);
+        return true;
+    }
+
+    void start() override {
+        vlog_debug(isRunning());
+        assert_(!isRunning());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            interrupted = false;
+        }
+        runner = std::make_shared<Worker>(*this);
+        runner->start();
+    }
+
+    void join() override {
+        vlog_debug(isRunning());
+        if (runner == nullptr) {
+            return;
+        }
+        runner->join();
+        runner = nullptr;
+    }
+
+    [[nodiscard]] bool isRunning() const override { return runner != nullptr; }
+
+private:
+    struct Entry {
+        TimerId id;
+        int64_t deadline;
+        std::shared_ptr<SenderBase<TimerId>> target;
+    };
+
+    class Worker : public thread_util::ThreadBase {
+    public:
+        explicit Worker(TimerServiceImpl &service)
+            : service(service) {}
+
+    protected:
+        void run() override {
+            log_debug("start timer");
+            while (isRunning()) {
+                service.processUntilNow();
+            }
+            log_debug("finished timer");
+        }
+
+        void interrupt() override {
+            {
+                std::lock_guard<std::mutex> lock(service.mutex);
+                service.interrupted = true;
+            }
+            service.condition.notify_all();
+        }
+
+    private:
+        TimerServiceImpl &service;
+    };
+
+    [[nodiscard]] int64_t tickAt(std::chrono::steady_clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time - origin).count() / resolution.count();
+    }
+
+    void processUntilNow() {
+        std::vector<std::pair<TimerId, std::shared_ptr<SenderBase<TimerId>>>> expired;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (entries.empty()) {
+                condition.wait(lock, [this]() { return interrupted || !entries.empty(); });
+            } else {
+                condition.wait_until(lock, origin + resolution * (processed_tick + 1));
+            }
+            if (interrupted) {
+                return;
+            }
+            const auto now = tickAt(std::chrono::steady_clock::now());
+            // After a long sleep, every slot has to be visited once at most.
+            const auto last = std::min(now, processed_tick + static_cast<int64_t>(slots.size()));
+            for (auto tick = processed_tick + 1; tick <= last; tick++) {
+                auto &slot = slots[static_cast<size_t>(tick) % slots.size()];
+                for (auto it = slot.begin(); it != slot.end();) {
+                    if (it->deadline <= now) {
+                        expired.emplace_back(it->id, std::move(it->target));
+                        entries.erase(it->id);
+                        it = slot.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            processed_tick = std::max(processed_tick, now);
+        }
+        for (const auto &[id, target] : expired) {
+            target->send(id);
+        }
+    }
+
+    const std::chrono::milliseconds resolution;
+    std::vector<std::list<Entry>> slots;
+    std::unordered_map<TimerId, std::pair<size_t, typename std::list<Entry>::iterator>> entries;
+    const std::chrono::steady_clock::time_point origin;
+    int64_t processed_tick = 0;
+    TimerId next_id = 1;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool interrupted = false;
+    std::shared_ptr<Worker> runner;
+};
+
 class EventRunnerControllerImpl : public EventRunnerInterface {
 public:
+    EventRunnerControllerImpl()
+        : timer_service(std::make_shared<TimerServiceImpl>()) {}
+
     ~EventRunnerControllerImpl() override { assert_(!is_running); }
 
     void add(const std::shared_ptr<EventRunnerInterface> &runner) {
@@ -256,6 +998,7 @@ public:
         for (const auto &r : runners) {
             r->start();
         }
+        timer_service->start();
         is_running = true;
     }
 
@@ -264,6 +1007,7 @@ public:
         if (!isRunning()) {
             return;
         }
+        timer_service->join();
         for (const auto &r : runners) {
             r->join();
         }
@@ -272,7 +1016,11 @@ public:
 
     [[nodiscard]] bool isRunning() const override { return is_running; }
 
+    // Shared by every runner of this controller.
+    [[nodiscard]] std::shared_ptr<TimerServiceImpl> timers() const { return timer_service; }
+
 private:
+    const std::shared_ptr<TimerServiceImpl> timer_service;
     std::vector<std::shared_ptr<EventRunnerInterface>> runners;
     bool is_running = false;
 };
@@ -298,6 +1046,9 @@ using Connection = std::shared_ptr<event_util_impl::ConnectionInterface<Args...>
 template<typename... Args>
 using QueuedConnection = std::shared_ptr<event_util_impl::QueuedConnectionImpl<Args...>>;
 
+template<typename... Args>
+using RingBufferConnection = std::shared_ptr<event_util_impl::RingBufferConnectionImpl<Args...>>;
+
 template<typename... Args>
 inline Connection<Args...> makeDirectConnection() {
     return std::make_shared<event_util_impl::DirectConnectionImpl<Args...>>();
@@ -312,19 +1063,52 @@ template<typename... Args, typename Listener>
 
 template<typename... Args>
 [[maybe_unused]] inline QueuedConnection<Args...> makeQueuedConnection(QueueLimitMode queue_limit_mode) {
-    return std::make_shared<event_util_impl::QueuedConnectionImpl<Args...>>(queue_limit_mode);
+    return std::make_shared<event_util_impl::QueuedConnectionImpl<Args...>>(
+        QueueConfig{queue_limit_mode, default_queue_limit_size});
+}
+
+template<typename... Args>
+[[maybe_unused]] inline QueuedConnection<Args...>
+makeCoalescingConnection(const std::common_type_t<CoalesceKey<Args...>> &coalesce_key) {
+    return std::make_shared<event_util_impl::QueuedConnectionImpl<Args...>>(
+        QueueConfig{QueueLimitMode::Coalesce, default_queue_limit_size}, coalesce_key);
+}
+
+template<typename... Args>
+[[maybe_unused]] inline RingBufferConnection<Args...> makeRingBufferConnection(
+    QueueLimitMode queue_limit_mode, int capacity = default_queue_limit_size) {
+    return std::make_shared<event_util_impl::RingBufferConnectionImpl<Args...>>(QueueConfig{queue_limit_mode, capacity});
 }
 
 using EventProcessor = std::shared_ptr<event_util_impl::EventProcessorInterface>;
+
+// Only queued connections keep metrics. Direct connections dispatch synchronously and have nothing to report.
+template<typename... Args>
+inline std::shared_ptr<const metrics_util::ConnectionMetrics> metricsOf(const Connection<Args...> &connection) {
+    const auto processor = std::dynamic_pointer_cast<event_util_impl::EventProcessorInterface>(connection);
+    assert_(processor != nullptr);
+    return processor->metrics();
+}
 using EventRunner = std::shared_ptr<event_util_impl::EventRunnerInterface>;
 using SingleThreadMultiEventRunner = std::shared_ptr<event_util_impl::SingleThreadMultiEventRunnerImpl>;
+using PoolRunner = std::shared_ptr<event_util_impl::PoolRunnerImpl>;
 using EventRunnerController = std::shared_ptr<event_util_impl::EventRunnerControllerImpl>;
+using TimerService = std::shared_ptr<event_util_impl::TimerServiceImpl>;
+using event_util_impl::TimerId;
 
 inline SingleThreadMultiEventRunner makeSingleThreadRunner(
     QueueLimitMode queue_limit_mode, const std::function<void()> &finalizer, const std::string &name) {
     return std::make_shared<event_util_impl::SingleThreadMultiEventRunnerImpl>(queue_limit_mode, finalizer, name);
 }
 
+inline PoolRunner makePoolRunner(
+    size_t thread_count,
+    QueueLimitMode queue_limit_mode,
+    const std::function<void()> &finalizer,
+    const std::string &name) {
+    return std::make_shared<event_util_impl::PoolRunnerImpl>(thread_count, queue_limit_mode, finalizer, name);
+}
+
 inline EventRunnerController makeRunnerController() {
     return std::make_shared<event_util_impl::EventRunnerControllerImpl>();
 }
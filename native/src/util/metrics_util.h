@@ -0,0 +1,211 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/json_util.h"
+
+namespace uma::metrics_util {
+
+inline uint64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+namespace metrics_impl {
+
+inline void updateMax(std::atomic<uint64_t> &target, uint64_t value) {
+    auto current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+}  // namespace metrics_impl
+
+/**
+ * Lock-free histogram with power-of-two microsecond buckets. Bucket i counts values below 2^i us.
+ * Percentiles are reported as the upper bound of the bucket they fall in.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t bucket_count = 24;  // Up to about 8 seconds. Slower values go to the last bucket.
+
+    void add(uint64_t nanoseconds) {
+        const auto microseconds = nanoseconds / 1000;
+        size_t bucket = 0;
+        while (bucket + 1 < bucket_count && (uint64_t{1} << bucket) <= microseconds) {
+            bucket++;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] json_util::Json snapshot() const {
+        std::array<uint64_t, bucket_count> counts{};
+        uint64_t total = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+
+        const auto percentile = [&](double ratio) -> json_util::Json {
+            if (total == 0) {
+                return nullptr;
+            }
+            const auto rank = static_cast<uint64_t>(ratio * static_cast<double>(total - 1));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucket_count; i++) {
+                seen += counts[i];
+                if (seen > rank) {
+                    return uint64_t{1} << i;
+                }
+            }
+            return nullptr;
+        };
+
+        json_util::Json histogram = json_util::Json::array();
+        for (size_t i = 0; i < bucket_count; i++) {
+            if (counts[i] > 0) {
+                histogram.push_back({{"lt_us", uint64_t{1} << i}, {"count", counts[i]}});
+            }
+        }
+
+        return {
+            {"p50_us", percentile(0.50)},
+            {"p99_us", percentile(0.99)},
+            {"histogram", histogram},
+        };
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+};
+
+/**
+ * Counters of a queued connection. Updated from senders and the runner without locks.
+ */
+class ConnectionMetrics {
+public:
+    void enqueued(size_t depth) {
+        enqueued_count.fetch_add(1, std::memory_order_relaxed);
+        metrics_impl::updateMax(max_depth, depth);
+    }
+
+    void dispatched(uint64_t enqueued_at) {
+        dispatched_count.fetch_add(1, std::memory_order_relaxed);
+        latency.add(steadyNanoseconds() - enqueued_at);
+    }
+
+    void dropped() { dropped_count.fetch_add(1, std::memory_order_relaxed); }
+
+    [[nodiscard]] json_util::Json snapshot() const {
+        return {
+            {"enqueued", enqueued_count.load(std::memory_order_relaxed)},
+            {"dispatched", dispatched_count.load(std::memory_order_relaxed)},
+            {"dropped", dropped_count.load(std::memory_order_relaxed)},
+            {"max_depth", max_depth.load(std::memory_order_relaxed)},
+            {"latency", latency.snapshot()},
+        };
+    }
+
+private:
+    std::atomic<uint64_t> enqueued_count = 0;
+    std::atomic<uint64_t> dispatched_count = 0;
+    std::atomic<uint64_t> dropped_count = 0;
+    std::atomic<uint64_t> max_depth = 0;
+    LatencyHistogram latency;
+};
+
+/**
+ * Counters of a runner. Busy time over the elapsed time of all threads tells whether the stage is saturated.
+ */
+class RunnerMetrics {
+public:
+    void started(size_t thread_count) {
+        threads.store(thread_count, std::memory_order_relaxed);
+        started_at.store(steadyNanoseconds(), std::memory_order_relaxed);
+    }
+
+    void dispatched(uint64_t began_at) {
+        dispatched_count.fetch_add(1, std::memory_order_relaxed);
+        busy_nanoseconds.fetch_add(steadyNanoseconds() - began_at, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] json_util::Json snapshot() const {
+        const auto elapsed = steadyNanoseconds() - started_at.load(std::memory_order_relaxed);
+        const auto busy = busy_nanoseconds.load(std::memory_order_relaxed);
+        const auto capacity = static_cast<double>(elapsed) * static_cast<double>(threads.load(std::memory_order_relaxed));
+        return {
+            {"threads", threads.load(std::memory_order_relaxed)},
+            {"dispatched", dispatched_count.load(std::memory_order_relaxed)},
+            {"busy_ms", static_cast<double>(busy) / 1e6},
+            {"utilization", capacity > 0 ? static_cast<double>(busy) / capacity : 0.},
+        };
+    }
+
+private:
+    std::atomic<uint64_t> threads = 0;
+    std::atomic<uint64_t> started_at = 0;
+    std::atomic<uint64_t> dispatched_count = 0;
+    std::atomic<uint64_t> busy_nanoseconds = 0;
+};
+
+/**
+ * A monotonic event count, like frames that were skipped.
+ */
+class Counter {
+public:
+    void increment() { count.fetch_add(1, std::memory_order_relaxed); }
+
+    [[nodiscard]] uint64_t value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> count = 0;
+};
+
+/**
+ * Names the metrics of a pipeline for reporting. Populated before the runners start, read from any thread.
+ */
+class MetricsRegistry {
+public:
+    void addConnection(const std::string &name, const std::shared_ptr<const ConnectionMetrics> &metrics) {
+        connections.emplace_back(name, metrics);
+    }
+
+    void addRunner(const std::string &name, const std::shared_ptr<const RunnerMetrics> &metrics) {
+        runners.emplace_back(name, metrics);
+    }
+
+    void addCounter(const std::string &name, const std::shared_ptr<const Counter> &counter) {
+        counters.emplace_back(name, counter);
+    }
+
+    [[nodiscard]] json_util::Json snapshot() const {
+        json_util::Json json = {
+            {"runners", json_util::Json::object()},
+            {"connections", json_util::Json::object()},
+            {"counters", json_util::Json::object()},
+        };
+        for (const auto &[name, metrics] : runners) {
+            json["runners"][name] = metrics->snapshot();
+        }
+        for (const auto &[name, metrics] : connections) {
+            json["connections"][name] = metrics->snapshot();
+        }
+        for (const auto &[name, counter] : counters) {
+            json["counters"][name] = counter->value();
+        }
+        return json;
+    }
+
+private:
+    std::vector<std::pair<std::string, std::shared_ptr<const ConnectionMetrics>>> connections;
+    std::vector<std::pair<std::string, std::shared_ptr<const RunnerMetrics>>> runners;
+    std::vector<std::pair<std::string, std::shared_ptr<const Counter>>> counters;
+};
+
+}  // namespace uma::metrics_util
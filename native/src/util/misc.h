@@ -1,10 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 namespace uma::chrono_util {
@@ -15,6 +17,55 @@ inline uint64_t timestamp() {
     return std::chrono::duration_cast<time_unit>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
+/**
+ * Source of the current time for time-based rules and timeouts.
+ * The wall clock reads the system time. The frame clock follows the timestamps of the frames being processed,
+ * so a recorded video can be processed faster than real time with the same results as playback.
+ */
+class ClockInterface {
+public:
+    virtual ~ClockInterface() = default;
+
+    [[nodiscard]] virtual uint64_t now() const = 0;
+
+    // If false, time passes only by advance(), so timeouts must be checked when frames arrive.
+    [[nodiscard]] virtual bool realTime() const = 0;
+
+    virtual void advance(uint64_t frame_timestamp) = 0;
+};
+
+class WallClock : public ClockInterface {
+public:
+    [[nodiscard]] uint64_t now() const override { return timestamp(); }
+
+    [[nodiscard]] bool realTime() const override { return true; }
+
+    void advance(uint64_t) override {}
+};
+
+class FrameClock : public ClockInterface {
+public:
+    [[nodiscard]] uint64_t now() const override { return current; }
+
+    [[nodiscard]] bool realTime() const override { return false; }
+
+    void advance(uint64_t frame_timestamp) override { current = std::max(current, frame_timestamp); }
+
+private:
+    uint64_t current = 0;
+};
+
+// Each thread must have its own clock, since a frame clock is advanced by the frames of the thread.
+using Clock = std::shared_ptr<ClockInterface>;
+
+inline Clock makeClock(bool frame_driven) {
+    if (frame_driven) {
+        return std::make_shared<FrameClock>();
+    } else {
+        return std::make_shared<WallClock>();
+    }
+}
+
 template<typename T, typename S>
 auto ms(std::chrono::duration<T, S> duration) {
     return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
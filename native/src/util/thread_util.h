@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "util/logger_util.h"
 #include "util/misc.h"
@@ -36,6 +38,7 @@ public:
             return;
         }
         is_running.store(false);
+        interrupt();
         thread->join();
         thread = nullptr;
     }
@@ -45,99 +48,132 @@ public:
 protected:
     virtual void run() = 0;
 
+    // Called after isRunning() turned false, to wake up run() if it is blocked.
+    virtual void interrupt() {}
+
 private:
     std::unique_ptr<std::thread> thread;
     std::atomic_bool is_running;
 };
 
-class Timer {
+/**
+ * Bounded lock-free MPMC queue (Dmitry Vyukov's sequence-numbered ring).
+ * Every slot is allocated on construction, so push and pop never touch the heap.
+ * The sequence scheme needs at least two slots, so a capacity of 1 is enforced on push instead.
+ */
+template<typename T>
+class RingBuffer {
 public:
-    Timer(
-        const std::chrono::milliseconds &duration,
-        const std::function<void()> &on_expired,
-        const std::function<void()> &on_canceled = nullptr)
-        : thread(nullptr)
-        , duration(duration)
-        , on_expired(on_expired)
-        , on_canceled(on_canceled) {
-        start();
+    explicit RingBuffer(size_t capacity)
+        : cells(std::max<size_t>(capacity, 2))
+        , capacity_(capacity) {
+        assert_(capacity > 0);
+        for (size_t i = 0; i < cells.size(); i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
     }
 
-    ~Timer() { cancel(); }
-
-    void cancel() {
-        log_debug("");
-
-        {
-            std::lock_guard<std::mutex> lock(condition_mutex);
-            cancelRequested = true;
-            condition.notify_all();
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    // The value is moved from only when this returns true.
+    bool tryPush(T &&value) {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[position % cells.size()];
+            const auto sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0) {
+                const auto pending = position - dequeue_position.load(std::memory_order_acquire);
+                if (static_cast<std::ptrdiff_t>(pending) >= static_cast<std::ptrdiff_t>(capacity_)) {
+                    return false;  // Full, when there are more slots than capacity.
+                }
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // Full.
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
         }
+        cell->value.emplace(std::move(value));
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
 
-        {
-            std::lock_guard<std::recursive_mutex> lock(thread_object_mutex);
-            if (thread != nullptr) {
-                thread->join();
-                thread = nullptr;
+    std::optional<T> tryPop() {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[position % cells.size()];
+            const auto sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (diff == 0) {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;  // Empty, or the producer of this slot has not finished writing yet.
+            } else {
+                position = dequeue_position.load(std::memory_order_relaxed);
             }
         }
+        std::optional<T> value = std::move(cell->value);
+        cell->value.reset();
+        cell->sequence.store(position + cells.size(), std::memory_order_release);
+        return value;
     }
 
-    [[nodiscard]] std::optional<bool> hasExpired() {
-        std::unique_lock<std::mutex> lock(condition_mutex, std::defer_lock);
-        if (!lock.try_lock()) {
-            return std::nullopt;
-        } else {
-            return expired;
+    // Pops the element at the given push position only. Waits while that element is still being written,
+    // and returns nullopt if it has already been popped by someone else. The position must not be past the head.
+    std::optional<T> tryPopAt(size_t position) {
+        Cell &cell = cells[position % cells.size()];
+        while (true) {
+            auto current = dequeue_position.load(std::memory_order_relaxed);
+            if (current != position) {
+                assert_(current > position);
+                return std::nullopt;
+            }
+            if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+                std::this_thread::yield();  // Not committed yet.
+                continue;
+            }
+            if (dequeue_position.compare_exchange_weak(current, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
         }
+        std::optional<T> value = std::move(cell.value);
+        cell.value.reset();
+        cell.sequence.store(position + cells.size(), std::memory_order_release);
+        return value;
     }
 
-private:
-    void start() {
-        std::lock_guard<std::recursive_mutex> lock(thread_object_mutex);
-        if (thread != nullptr) {
-            cancel();
-        }
-        assert_(thread == nullptr);
+    // Push position of the oldest element, or of the next one when empty.
+    [[nodiscard]] size_t headPosition() const { return dequeue_position.load(std::memory_order_acquire); }
 
-        cancelRequested = false;
-        expired = std::nullopt;
-        const auto timeout = std::chrono::steady_clock::now() + duration;
-        thread = std::make_unique<std::thread>([=]() { run(timeout); });
+    [[nodiscard]] size_t size() const {
+        const auto enqueued = enqueue_position.load(std::memory_order_relaxed);
+        const auto dequeued = dequeue_position.load(std::memory_order_relaxed);
+        return (enqueued > dequeued) ? (enqueued - dequeued) : 0;
     }
 
-    void run(std::chrono::steady_clock::time_point timeout) {
-        log_debug("started: {}", cancelRequested);
+    [[nodiscard]] bool empty() const { return size() == 0; }
 
-        std::unique_lock<std::mutex> cancel_lock(condition_mutex);
-        if (condition.wait_until(cancel_lock, timeout, [&]() { return cancelRequested; })) {
-            log_debug("canceled: {}", cancelRequested);
-            expired = false;
-            if (on_canceled != nullptr) {
-                on_canceled();
-            }
-        } else {
-            log_debug("expired: {}", cancelRequested);
-            expired = true;
-            on_expired();
-        }
-
-        log_debug("finished: {}", cancelRequested);
-    }
+    [[nodiscard]] size_t capacity() const { return capacity_; }
 
 private:
-    std::unique_ptr<std::thread> thread;
-    std::recursive_mutex thread_object_mutex;
-
-    std::condition_variable condition;
-    std::mutex condition_mutex;
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
 
-    bool cancelRequested = false;
-    std::optional<bool> expired = std::nullopt;
+    std::vector<Cell> cells;
+    const size_t capacity_;
 
-    const std::chrono::milliseconds duration;
-    const std::function<void()> on_expired;
-    const std::function<void()> on_canceled;
+    alignas(64) std::atomic<size_t> enqueue_position = 0;
+    alignas(64) std::atomic<size_t> dequeue_position = 0;
 };
 
 }  // namespace uma::thread_util
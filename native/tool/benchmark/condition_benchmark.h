@@ -0,0 +1,177 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "condition/compiled_condition.h"
+#include "condition/condition.h"
+#include "condition/serializer.h"
+#include "cv/frame.h"
+#include "util/json_util.h"
+#include "util/misc.h"
+
+namespace uma::tool {
+
+/**
+ * Evaluates the scene context condition on synthetic frames, as a tree and as compiled programs,
+ * and measures the evaluation cost per frame. Results of the exhaustive program must match the tree on every frame.
+ * The frames are not chara detail screens, like most frames in live capture, so short-circuit evaluation
+ * should stop after a few leaves.
+ * Short-circuit evaluation is also checked against the tree on frames where the siblings of a Stable rule flip,
+ * since a skipped stateful subtree would lose its state and lag behind the tree.
+ */
+class ConditionBenchmark {
+public:
+    ConditionBenchmark(const json_util::Json &condition_json, int frames)
+        : condition_json(condition_json)
+        , frames(frames) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        const auto images = syntheticImages();
+        const auto tree = condition::serializer::conditionFromJson(condition_json);
+        const auto compiled = condition::compile(condition::serializer::conditionFromJson(condition_json));
+        const auto short_circuit =
+            condition::compile(condition::serializer::conditionFromJson(condition_json), condition::ShortCircuit);
+        const auto tree_clock = chrono_util::makeClock(true);
+        const auto compiled_clock = chrono_util::makeClock(true);
+
+        int mismatches = 0;
+        for (int i = 0; i < frames; i++) {
+            const auto frame = Frame(images[i % images.size()], i * 16);
+            tree_clock->advance(frame.timestamp());
+            compiled_clock->advance(frame.timestamp());
+            tree->update(frame, *tree_clock);
+            compiled->update(frame, *compiled_clock);
+            mismatches += tree->met() != compiled->met();
+        }
+
+        const auto &short_circuit_program = dynamic_cast<const condition::CompiledCondition<Frame> &>(*short_circuit);
+        return {
+            {"frames", frames},
+            {"mismatches", mismatches},
+            {"short_circuit_mismatches", countFlippingMismatches()},
+            {"instructions", short_circuit_program.instructionCount()},
+            {"tree_us_per_frame", measure(tree, images)},
+            {"compiled_us_per_frame", measure(compiled, images)},
+            {"short_circuit_us_per_frame", measure(short_circuit, images)},
+            {"short_circuit_leaves_per_frame", short_circuit_program.lastLeafCount()},
+        };
+    }
+
+private:
+    [[nodiscard]] static std::vector<cv::Mat> syntheticImages() {
+        const auto size = cv::Size(540, 960);
+        cv::Mat noise(size, CV_8UC3);
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(255));
+        return {
+            cv::Mat(size, CV_8UC3, cv::Scalar::all(0)),
+            cv::Mat(size, CV_8UC3, cv::Scalar::all(255)),
+            noise,
+        };
+    }
+
+    // Runs a logical node of a point and a stable point both as a tree and short-circuited, for both LogicalAnd and
+    // LogicalOr, and counts the frames where they disagree. The frames change in runs of random length.
+    [[nodiscard]] int countFlippingMismatches() const {
+        const auto size = cv::Size(540, 960);
+        std::vector<cv::Mat> images;
+        for (int i = 0; i < 4; i++) {
+            cv::Mat image(size, CV_8UC3);
+            image(cv::Rect(0, 0, size.width / 2, size.height)).setTo(cv::Scalar::all((i & 1) ? 255 : 0));
+            image(cv::Rect(size.width / 2, 0, size.width / 2, size.height)).setTo(cv::Scalar::all((i & 2) ? 255 : 0));
+            images.push_back(image);
+        }
+
+        int mismatches = 0;
+        const std::vector<std::string> types = {
+            "ParallelCondition<Frame,LogicalAnd,Empty>",
+            "ParallelCondition<Frame,LogicalOr,Empty>",
+        };
+        for (const auto &type : types) {
+            const auto json = flippingCondition(type);
+            const auto tree = condition::serializer::conditionFromJson(json);
+            const auto short_circuit =
+                condition::compile(condition::serializer::conditionFromJson(json), condition::ShortCircuit);
+            const auto tree_clock = chrono_util::makeClock(true);
+            const auto short_circuit_clock = chrono_util::makeClock(true);
+            std::mt19937 random(0);
+            size_t image_index = 0;
+            for (int i = 0; i < frames; i++) {
+                if (random() % 4 == 0) {
+                    image_index = random() % images.size();
+                }
+                const auto frame = Frame(images[image_index], i * 16);
+                tree_clock->advance(frame.timestamp());
+                short_circuit_clock->advance(frame.timestamp());
+                tree->update(frame, *tree_clock);
+                short_circuit->update(frame, *short_circuit_clock);
+                mismatches += tree->met() != short_circuit->met();
+            }
+        }
+        return mismatches;
+    }
+
+    // The cheap point on the left decides the node on about half of the frames, so short-circuit evaluation would
+    // skip the stable point on the right if it were not stateful.
+    [[nodiscard]] static json_util::Json flippingCondition(const std::string &type) {
+        return {
+            {"type", type},
+            {"rule", nullptr},
+            {"children",
+             json_util::Json::array({
+                 whitePoint(0.25),
+                 {
+                     {"type", "NestedCondition<Frame,Stable,TimestampState>"},
+                     {"rule", {{"threshold", 50}}},
+                     {"child", whitePoint(0.75)},
+                 },
+             })},
+        };
+    }
+
+    [[nodiscard]] static json_util::Json whitePoint(double x) {
+        return {
+            {"type", "PlainCondition<Frame,PointColor,Empty>"},
+            {"rule",
+             {
+                 {"point", {{"x", x}, {"y", 0.5}, {"anchor", {{"h", "IntersectStart"}, {"v", "IntersectStart"}}}}},
+                 {"color_range",
+                  {
+                      {"min", {{"r", 200}, {"g", 200}, {"b", 200}}},
+                      {"max", {{"r", 255}, {"g", 255}, {"b", 255}}},
+                  }},
+             }},
+        };
+    }
+
+    [[nodiscard]] double measure(
+        const std::shared_ptr<condition::Condition<Frame>> &condition, const std::vector<cv::Mat> &images) const {
+        const auto clock = chrono_util::makeClock(true);
+        std::vector<Frame> inputs;
+        for (size_t i = 0; i < images.size(); i++) {
+            inputs.emplace_back(images[i], i);
+        }
+
+        const auto started = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            const auto &frame = inputs[i % inputs.size()];
+            clock->advance(i * 16);
+            condition->update(frame, *clock);
+        }
+        const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started);
+        return elapsed.count() / static_cast<double>(frames);
+    }
+
+    const json_util::Json condition_json;
+    const int frames;
+};
+
+}  // namespace uma::tool
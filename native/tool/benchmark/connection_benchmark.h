@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "util/event_util.h"
+#include "util/json_util.h"
+#include "util/stds.h"
+
+namespace uma::tool {
+
+namespace benchmark_impl {
+
+inline uint64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline json_util::Json latencySummary(std::vector<uint64_t> &latencies) {
+    if (latencies.empty()) {
+        return nullptr;
+    }
+    stds::sort(latencies);
+    const auto percentile = [&](double ratio) {
+        const auto index = static_cast<size_t>(ratio * static_cast<double>(latencies.size() - 1));
+        return static_cast<double>(latencies[index]) / 1000.;
+    };
+    return {
+        {"p50_us", percentile(0.50)},
+        {"p99_us", percentile(0.99)},
+        {"max_us", percentile(1.00)},
+    };
+}
+
+// Stands in for Frame, and counts how often it is constructed, copied and moved.
+struct CountedPayload {
+    CountedPayload() { constructed++; }
+    CountedPayload(const CountedPayload &) { copied++; }
+    CountedPayload(CountedPayload &&) noexcept { moved++; }
+    CountedPayload &operator=(const CountedPayload &) {
+        copied++;
+        return *this;
+    }
+    CountedPayload &operator=(CountedPayload &&) noexcept {
+        moved++;
+        return *this;
+    }
+
+    static void reset() {
+        constructed = 0;
+        copied = 0;
+        moved = 0;
+    }
+
+    static inline std::atomic_int constructed = 0;
+    static inline std::atomic_int copied = 0;
+    static inline std::atomic_int moved = 0;
+};
+
+}  // namespace benchmark_impl
+
+/**
+ * Pushes timestamps through a single queued connection and measures throughput and enqueue-to-dispatch latency.
+ * Block mode is used, so every event is delivered and the producer is throttled by the consumer.
+ */
+class ConnectionBenchmark {
+public:
+    explicit ConnectionBenchmark(int events)
+        : events(events) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        return {
+            {"event_queue", measure(event_util::EventQueueBackend)},
+            {"ring_buffer", measure(event_util::RingBufferBackend)},
+        };
+    }
+
+private:
+    [[nodiscard]] json_util::Json measure(event_util::QueueBackend queue_backend) const {
+        const auto runner = event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "benchmark");
+        const auto connection = runner->makeConnection<uint64_t>(queue_backend);
+
+        std::vector<uint64_t> latencies;
+        latencies.reserve(events);
+        std::atomic_int received = 0;
+        connection->listen([&](uint64_t sent) {
+            latencies.push_back(benchmark_impl::nowNanoseconds() - sent);
+            received.fetch_add(1, std::memory_order_release);
+        });
+
+        runner->start();
+        const auto started = std::chrono::steady_clock::now();
+        for (int i = 0; i < events; i++) {
+            connection->send(benchmark_impl::nowNanoseconds());
+        }
+        while (received.load(std::memory_order_acquire) < events) {
+            std::this_thread::yield();
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        runner->join();
+
+        return {
+            {"events", events},
+            {"events_per_second", static_cast<double>(events) / elapsed},
+            {"latency", benchmark_impl::latencySummary(latencies)},
+        };
+    }
+
+    const int events;
+};
+
+/**
+ * Paces events through capture -> distributor -> scraper runners, as NativeApi does with frames,
+ * and measures the latency of each hop while the runners are mostly idle.
+ */
+class ChainBenchmark {
+public:
+    ChainBenchmark(int events, std::chrono::microseconds interval)
+        : events(events)
+        , interval(interval) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        const auto runners = event_util::makeRunnerController();
+        const auto distributor_runner =
+            event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "distributor");
+        const auto scraper_runner =
+            event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "scraper");
+        runners->add(distributor_runner);
+        runners->add(scraper_runner);
+
+        const auto captured = distributor_runner->makeConnection<uint64_t>(event_util::RingBufferBackend);
+        const auto updated = scraper_runner->makeConnection<uint64_t, uint64_t>(event_util::RingBufferBackend);
+
+        std::vector<uint64_t> distributor_latencies;
+        std::vector<uint64_t> scraper_latencies;
+        std::vector<uint64_t> total_latencies;
+        distributor_latencies.reserve(events);
+        scraper_latencies.reserve(events);
+        total_latencies.reserve(events);
+        std::atomic_int received = 0;
+
+        captured->listen([&](uint64_t captured_at) {
+            const auto now = benchmark_impl::nowNanoseconds();
+            distributor_latencies.push_back(now - captured_at);
+            updated->send(captured_at, now);
+        });
+        updated->listen([&](uint64_t captured_at, uint64_t distributed_at) {
+            const auto now = benchmark_impl::nowNanoseconds();
+            scraper_latencies.push_back(now - distributed_at);
+            total_latencies.push_back(now - captured_at);
+            received.fetch_add(1, std::memory_order_release);
+        });
+
+        runners->start();
+        auto next = std::chrono::steady_clock::now();
+        for (int i = 0; i < events; i++) {
+            next += interval;
+            std::this_thread::sleep_until(next);
+            captured->send(benchmark_impl::nowNanoseconds());
+        }
+        while (received.load(std::memory_order_acquire) < events) {
+            std::this_thread::yield();
+        }
+        runners->join();
+
+        return {
+            {"events", events},
+            {"interval_us", interval.count()},
+            {"capture_to_distributor", benchmark_impl::latencySummary(distributor_latencies)},
+            {"distributor_to_scraper", benchmark_impl::latencySummary(scraper_latencies)},
+            {"capture_to_scraper", benchmark_impl::latencySummary(total_latencies)},
+        };
+    }
+
+private:
+    const int events;
+    const std::chrono::microseconds interval;
+};
+
+/**
+ * Sends payloads along the frame path of NativeApi (capture -> distributor -> scene context -> scraper)
+ * and counts payload constructions, copies and moves per event, by value and through a shared handle.
+ * Handle copies are counted as the largest use_count seen by the last listener.
+ */
+class PayloadCopyBenchmark {
+public:
+    explicit PayloadCopyBenchmark(int events)
+        : events(events) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        using benchmark_impl::CountedPayload;
+        return {
+            {"by_value", measure<CountedPayload>([]() { return CountedPayload{}; })},
+            {"shared", measure<event_util::Shared<CountedPayload>>([]() {
+                 return event_util::makeShared<CountedPayload>();
+             })},
+        };
+    }
+
+private:
+    template<typename Payload, typename Factory>
+    [[nodiscard]] json_util::Json measure(const Factory &factory) const {
+        using benchmark_impl::CountedPayload;
+        const auto distributor_runner =
+            event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "distributor");
+        const auto scraper_runner =
+            event_util::makeSingleThreadRunner(event_util::QueueLimitMode::Block, nullptr, "scraper");
+        const auto captured = distributor_runner->makeConnection<Payload>(event_util::RingBufferBackend);
+        const auto updated = scraper_runner->makeConnection<Payload, int>(event_util::RingBufferBackend);
+
+        std::atomic_int received = 0;
+        long max_use_count = 0;
+        captured->listen([&](const Payload &payload) { updated->send(payload, 0); });
+        updated->listen([&](const Payload &payload, int) {
+            if constexpr (std::is_same_v<Payload, event_util::Shared<CountedPayload>>) {
+                max_use_count = std::max(max_use_count, payload.use_count());
+            }
+            received.fetch_add(1, std::memory_order_release);
+        });
+
+        CountedPayload::reset();
+        distributor_runner->start();
+        scraper_runner->start();
+        for (int i = 0; i < events; i++) {
+            captured->send(factory());
+        }
+        while (received.load(std::memory_order_acquire) < events) {
+            std::this_thread::yield();
+        }
+        distributor_runner->join();
+        scraper_runner->join();
+
+        const auto per_event = [&](int count) { return static_cast<double>(count) / static_cast<double>(events); };
+        return {
+            {"events", events},
+            {"constructed_per_event", per_event(CountedPayload::constructed)},
+            {"copied_per_event", per_event(CountedPayload::copied)},
+            {"moved_per_event", per_event(CountedPayload::moved)},
+            {"max_use_count", max_use_count},
+        };
+    }
+
+    const int events;
+};
+
+/**
+ * Feeds a backlog of CPU-bound jobs, standing in for stitch and recognize, to a pool runner through a reentrant
+ * connection, and measures how the drain time scales with the number of workers.
+ */
+class PoolBenchmark {
+public:
+    PoolBenchmark(int jobs, std::chrono::microseconds job_duration)
+        : jobs(jobs)
+        , job_duration(job_duration) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        const auto max_workers = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        json_util::Json result = json_util::Json::array();
+        for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+            result.push_back(measure(workers));
+        }
+        return result;
+    }
+
+private:
+    [[nodiscard]] json_util::Json measure(size_t workers) const {
+        const auto runner = event_util::makePoolRunner(workers, event_util::QueueLimitMode::NoLimit, nullptr, "pool");
+        const auto connection = runner->makeReentrantConnection<int>();
+
+        std::atomic_int received = 0;
+        connection->listen([&](int) {
+            const auto deadline = std::chrono::steady_clock::now() + job_duration;
+            while (std::chrono::steady_clock::now() < deadline) {
+                // Busy, like image processing.
+            }
+            received.fetch_add(1, std::memory_order_release);
+        });
+
+        runner->start();
+        const auto started = std::chrono::steady_clock::now();
+        for (int i = 0; i < jobs; i++) {
+            connection->send(i);
+        }
+        while (received.load(std::memory_order_acquire) < jobs) {
+            std::this_thread::yield();
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        runner->join();
+
+        return {
+            {"workers", workers},
+            {"jobs", jobs},
+            {"jobs_per_second", static_cast<double>(jobs) / elapsed},
+        };
+    }
+
+    const int jobs;
+    const std::chrono::microseconds job_duration;
+};
+
+}  // namespace uma::tool
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "cv/frame.h"
+#include "util/json_util.h"
+
+namespace uma::tool {
+
+/**
+ * Feeds synthetic RGBA buffers through the strided ingest path, as the platforms do, and measures frames per second.
+ * Idle frames are signed and sampled at about as many pixels as the scene condition reads. Active frames are also
+ * converted as a whole, as when the scraper reads them. Every buffer must be released once its frame is dropped.
+ * Only the core is involved, so this runs on any platform the core builds on.
+ */
+class IngestBenchmark {
+public:
+    explicit IngestBenchmark(int frames)
+        : frames(frames) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        json_util::Json result = json_util::Json::array();
+        result.push_back(measure(540, 960, 0));
+        result.push_back(measure(1080, 1920, 64));  // Row padding, like the buffers of an image reader.
+        result.push_back(measure(1440, 2560, 0));
+        return result;
+    }
+
+private:
+    [[nodiscard]] json_util::Json measure(int width, int height, int padding) const {
+        const size_t row_stride = static_cast<size_t>(width + padding) * 4;
+        std::mt19937 random(0);
+        std::vector<std::vector<uint8_t>> buffers(buffer_count);
+        for (auto &buffer : buffers) {
+            buffer.resize(row_stride * height);
+            for (auto &value : buffer) {
+                value = static_cast<uint8_t>(random());
+            }
+        }
+
+        std::vector<Point<double>> points;
+        for (int y = 0; y < 20; y++) {
+            for (int x = 0; x < 15; x++) {
+                points.emplace_back((x + 0.5) / 15., (y + 0.5) / 20. * 16. / 9.);
+            }
+        }
+
+        std::atomic<int> released = 0;
+        const auto time = [&](bool active) {
+            uint64_t checksum = 0;
+            const auto started = std::chrono::steady_clock::now();
+            for (int i = 0; i < frames; i++) {
+                const auto &buffer = buffers[i % buffers.size()];
+                const auto frame = Frame::deferred(
+                                       buffer.data(),
+                                       width,
+                                       height,
+                                       row_stride,
+                                       RGBA8888,
+                                       frame_size,
+                                       [&released]() { released++; },
+                                       i)
+                                       .withSignature();
+                for (const auto &point : points) {
+                    checksum += frame.colorAt(point).r();
+                }
+                if (active) {
+                    checksum += frame.data().data[0];
+                }
+            }
+            const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return json_util::Json{{"fps", frames / elapsed}, {"checksum", checksum}};
+        };
+
+        const auto idle = time(false);
+        const auto active = time(true);
+        return {
+            {"width", width},
+            {"height", height},
+            {"row_stride", row_stride},
+            {"idle", idle},
+            {"active", active},
+            {"released", released.load()},
+            {"expected_released", frames * 2},
+        };
+    }
+
+    static constexpr size_t buffer_count = 4;
+    inline static const Size<int> frame_size = {540, 960};
+
+    const int frames;
+};
+
+}  // namespace uma::tool
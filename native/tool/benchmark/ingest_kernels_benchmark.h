@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "cv/ingest_kernels.h"
+#include "util/json_util.h"
+
+namespace uma::tool {
+
+/**
+ * Measures ingest_kernels::resizeToBGR with each kernel the CPU supports, against cv::resize followed by cv::cvtColor,
+ * from the capture sizes of 4K, 1080p and 1440p devices to the frame size.
+ * The largest difference from OpenCV is reported too. It is compared with INTER_AREA for the integer ratios,
+ * which is what the box filter computes, and with INTER_LINEAR otherwise.
+ */
+class IngestKernelBenchmark {
+public:
+    explicit IngestKernelBenchmark(int iterations)
+        : iterations(iterations) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        json_util::Json result = json_util::Json::array();
+        result.push_back(measure({2160, 3840}));
+        result.push_back(measure({1080, 1920}));
+        result.push_back(measure({1440, 2560}));
+        return result;
+    }
+
+private:
+    [[nodiscard]] json_util::Json measure(const cv::Size &source_size) const {
+        std::mt19937 random(0);
+        cv::Mat source(source_size, CV_8UC4);
+        for (int y = 0; y < source.rows; y++) {
+            auto *row = source.ptr(y);
+            for (int x = 0; x < source.cols * 4; x++) {
+                // Gradients with a little noise, closer to a screen than pure noise.
+                row[x] = static_cast<uint8_t>((x / 4 + y + (x % 4) * 64 + random() % 8) & 0xff);
+            }
+        }
+
+        const bool box = ingest_kernels::boxRatio(source.cols, source.rows, frame_size.width, frame_size.height) > 0;
+        cv::Mat scaled, expected;
+        const auto time = [&](const auto &convert) {
+            const auto started = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                convert();
+            }
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count()
+                / iterations;
+        };
+        const auto two_pass_us = time([&]() {
+            cv::resize(source, scaled, frame_size, 0, 0, box ? cv::INTER_AREA : cv::INTER_LINEAR);
+            cv::cvtColor(scaled, expected, cv::COLOR_RGBA2BGR);
+        });
+
+        json_util::Json kernels = json_util::Json::object();
+        cv::Mat image(frame_size, CV_8UC3);
+        for (const auto &kernel : {pixel_kernel::Scalar, pixel_kernel::SSE4, pixel_kernel::AVX2, pixel_kernel::NEON}) {
+            if (!pixel_kernel::supported(kernel)) {
+                continue;
+            }
+            const auto fused_us = time([&]() {
+                ingest_kernels::resizeToBGR(
+                    source.data,
+                    source.step,
+                    source.cols,
+                    source.rows,
+                    RGBA8888,
+                    image.data,
+                    image.step,
+                    image.cols,
+                    image.rows,
+                    kernel);
+            });
+            kernels[pixel_kernel::kernelName(kernel)] = {
+                {"fused_us", fused_us},
+                {"max_difference", cv::norm(image, expected, cv::NORM_INF)},
+            };
+        }
+
+        return {
+            {"width", source.cols},
+            {"height", source.rows},
+            {"filter", box ? "box" : "bilinear"},
+            {"two_pass_us", two_pass_us},
+            {"best", pixel_kernel::kernelName(pixel_kernel::bestKernel())},
+            {"kernels", kernels},
+        };
+    }
+
+    inline static const cv::Size frame_size = {540, 960};
+
+    const int iterations;
+};
+
+}  // namespace uma::tool
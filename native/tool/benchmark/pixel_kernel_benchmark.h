@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "cv/pixel_kernel.h"
+#include "util/json_util.h"
+
+namespace uma::tool {
+
+/**
+ * Measures pixel_kernel::difference with each kernel the CPU supports, on frames of the sizes the app sees.
+ * A stationary pair is summed in full, and a moving pair is summed with the bound used by StationaryFrameCatcher.
+ */
+class PixelDifferenceBenchmark {
+public:
+    explicit PixelDifferenceBenchmark(int iterations)
+        : iterations(iterations) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        json_util::Json result = json_util::Json::array();
+        for (const auto &[width, height] : {std::pair{540, 960}, std::pair{1080, 1920}}) {
+            result.push_back(measure(width, height));
+        }
+        return result;
+    }
+
+private:
+    [[nodiscard]] json_util::Json measure(int width, int height) const {
+        const size_t step = width * 3;
+        std::mt19937 random(0);
+        std::vector<uint8_t> base(step * height);
+        for (auto &value : base) {
+            value = static_cast<uint8_t>(random());
+        }
+        auto stationary = base;  // Only sensor noise below the threshold.
+        for (size_t i = 0; i < stationary.size(); i += 7) {
+            stationary[i] ^= 1;
+        }
+        auto moving = base;  // Scrolled by a few rows.
+        std::rotate(moving.begin(), moving.begin() + step * 8, moving.end());
+
+        json_util::Json kernels = json_util::Json::object();
+        for (const auto &kernel : {pixel_kernel::Scalar, pixel_kernel::SSE4, pixel_kernel::AVX2, pixel_kernel::NEON}) {
+            if (!pixel_kernel::supported(kernel)) {
+                continue;
+            }
+            const auto time = [&](const std::vector<uint8_t> &other, uint64_t bound) {
+                uint64_t checksum = 0;
+                const auto started = std::chrono::steady_clock::now();
+                for (int i = 0; i < iterations; i++) {
+                    checksum += pixel_kernel::difference(
+                        base.data(), step, other.data(), step, width, height, ignore_threshold, bound, kernel);
+                }
+                const auto elapsed =
+                    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+                return std::make_pair(elapsed / iterations, checksum / iterations);
+            };
+            const auto [stationary_us, stationary_sum] = time(stationary, stationary_color_threshold);
+            const auto [moving_us, moving_sum] = time(moving, stationary_color_threshold);
+            const auto [full_us, full_sum] = time(moving, std::numeric_limits<uint64_t>::max());
+            kernels[pixel_kernel::kernelName(kernel)] = {
+                {"stationary_us", stationary_us},
+                {"moving_early_exit_us", moving_us},
+                {"moving_full_us", full_us},
+                {"stationary_sum", stationary_sum},
+                {"moving_full_sum", full_sum},
+            };
+        }
+
+        return {
+            {"width", width},
+            {"height", height},
+            {"best", pixel_kernel::kernelName(pixel_kernel::bestKernel())},
+            {"kernels", kernels},
+        };
+    }
+
+    // The values of the scene scraper config.
+    static constexpr int ignore_threshold = 18;
+    static constexpr uint64_t stationary_color_threshold = 100;
+
+    const int iterations;
+};
+
+}  // namespace uma::tool
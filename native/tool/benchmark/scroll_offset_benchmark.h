@@ -0,0 +1,196 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#include <opencv2/opencv.hpp>
+#pragma clang diagnostic pop
+
+#include "chara_detail/chara_detail_config.h"
+#include "chara_detail/chara_detail_scene_scraper.h"
+#include "cv/frame.h"
+#include "cv/frame_dump.h"
+#include "util/json_util.h"
+
+namespace uma::tool {
+
+/**
+ * Compares the offset estimation of the scroll area by row projection, by feature matching, and by both as the scraper
+ * runs them, in accuracy and in cost per pair of consecutive frames.
+ * With frame dumps, the scroll area is cropped from each recorded frame with the scraper config, and the guess comes
+ * from the scroll bar as in the scraper. Recorded frames have no ground truth, so the feature matching is the
+ * reference: the other estimations are measured only for their agreement with it, and its own accuracy is not
+ * measured at all.
+ * Without, frames are cropped from a synthetic scrolling page, and the offset they were cropped at is the reference.
+ */
+class ScrollOffsetBenchmark {
+public:
+    ScrollOffsetBenchmark(
+        const json_util::Json &scraper_config_json, const std::vector<std::filesystem::path> &dump_paths, int pairs)
+        : config(scraper_config_json.get<chara_detail::scraper_config::CharaDetailSceneScraperConfig>().common)
+        , dump_paths(dump_paths)
+        , pairs(pairs) {}
+
+    [[nodiscard]] json_util::Json run() const {
+        std::vector<Sample> samples = dump_paths.empty() ? syntheticSamples() : recordedSamples();
+
+        const auto estimator = chara_detail::scraper_impl::ImageOffsetEstimator();
+        Tally features, projection, combined;
+        for (auto &sample : samples) {
+            const auto measure = [&](Tally &tally, const auto &estimate) {
+                // Descriptors are computed for each estimation, so that each pays for its own detection.
+                chara_detail::scraper_impl::FrameDescriptor from = {sample.from}, to = {sample.to};
+                const auto started = std::chrono::steady_clock::now();
+                const auto offset = estimate(from, to);
+                tally.elapsed_us +=
+                    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+                return offset;
+            };
+            const auto feature_offset = measure(features, [&](auto &from, auto &to) {
+                return estimator.estimateByFeatures(from, to, sample.guess);
+            });
+            const auto projection_offset = measure(projection, [&](auto &from, auto &to) {
+                return estimator.estimateByProjection(from, to, sample.guess);
+            });
+            const auto combined_offset =
+                measure(combined, [&](auto &from, auto &to) { return estimator.estimate(from, to, sample.guess); });
+
+            const auto reference = sample.truth ? sample.truth : feature_offset;
+            features.add(feature_offset, sample.truth);  // Not compared with itself.
+            projection.add(projection_offset, reference);
+            combined.add(combined_offset, reference);
+        }
+
+        return {
+            {"source", dump_paths.empty() ? "synthetic" : "recorded"},
+            {"reference", dump_paths.empty() ? "ground_truth" : "feature_path"},
+            {"pairs", samples.size()},
+            {"features", features.toJson(samples.size())},
+            {"projection", projection.toJson(samples.size())},
+            {"combined", combined.toJson(samples.size())},
+        };
+    }
+
+private:
+    struct Sample {
+        Frame from;
+        Frame to;
+        double guess;
+        std::optional<double> truth;
+    };
+
+    struct Tally {
+        int found = 0;
+        int compared = 0;
+        int within_pixel = 0;
+        double max_error = 0.0;
+        double elapsed_us = 0.0;
+
+        void add(const std::optional<double> &offset, const std::optional<double> &reference) {
+            if (!offset) {
+                return;
+            }
+            found++;
+            if (!reference) {
+                return;
+            }
+            const double error = std::abs(offset.value() - reference.value());
+            compared++;
+            within_pixel += error <= 1.0;
+            max_error = std::max(max_error, error);
+        }
+
+        [[nodiscard]] json_util::Json toJson(size_t samples) const {
+            return {
+                {"found", found},
+                {"compared", compared},
+                {"within_pixel", within_pixel},
+                {"max_error", max_error},
+                {"us_per_pair", samples > 0 ? elapsed_us / samples : 0.0},
+            };
+        }
+    };
+
+    [[nodiscard]] std::vector<Sample> recordedSamples() const {
+        const auto scroll_bar = chara_detail::scraper_impl::ScrollBarOffsetEstimator(
+            config.scroll_bar_bg_color, config.scroll_bar_scan_line);
+
+        std::vector<Sample> samples;
+        for (const auto &path : dump_paths) {
+            const auto reader = frame_dump::FrameDumpReader(path);
+            const auto frame_size = FrameAnchor::canonicalSize(reader.frameSize()).toCVSize();
+            std::optional<Frame> previous;
+            for (size_t i = 0; i < reader.frameCount() && samples.size() < pairs; i++) {
+                // Normalized as NativeApi does, so the scroll area is where the scraper crops it.
+                cv::Mat image = reader.imageAt(i);
+                if (image.type() == CV_8UC4) {
+                    cv::Mat converted;
+                    cv::cvtColor(image, converted, cv::COLOR_BGRA2BGR);
+                    image = converted;
+                }
+                if (image.size() != frame_size) {
+                    cv::Mat resized;
+                    cv::resize(image, resized, frame_size, 0, 0, cv::INTER_LINEAR);
+                    image = resized;
+                }
+                const auto frame = Frame(image, reader.timestampAt(i)).copy(config.scroll_area_rect);
+                if (!previous) {
+                    previous = frame;
+                    continue;
+                }
+
+                chara_detail::scraper_impl::FrameDescriptor from = {previous.value()}, to = {frame};
+                const auto guess = scroll_bar.estimate(from, to);
+                if (guess) {
+                    samples.push_back({previous.value(), frame, guess.value(), std::nullopt});
+                }
+                previous = frame;
+            }
+        }
+        return samples;
+    }
+
+    [[nodiscard]] std::vector<Sample> syntheticSamples() const {
+        std::mt19937 random(0);
+        const cv::Size area_size = {540, 700};
+        cv::Mat page(area_size.height * 6, area_size.width, CV_8UC3, cv::Scalar(245, 245, 245));
+        for (int y = 8; y < page.rows - 40; y += 36) {
+            // Rows of words, like the lists of skills and factors.
+            int x = 16 + static_cast<int>(random() % 24);
+            while (x < page.cols - 80) {
+                const int width = 30 + static_cast<int>(random() % 90);
+                const auto shade = static_cast<double>(40 + random() % 120);
+                cv::rectangle(page, {x, y + 8}, {x + width, y + 26}, cv::Scalar(shade, shade + 20, shade + 40), -1);
+                x += width + 12 + static_cast<int>(random() % 30);
+            }
+            cv::putText(
+                page, std::to_string(random() % 100000), {24, y + 24}, cv::FONT_HERSHEY_SIMPLEX, 0.6, {0, 0, 0});
+        }
+
+        std::vector<Sample> samples;
+        const int maximum_top = page.rows - area_size.height - 200;
+        for (size_t i = 0; i < pairs; i++) {
+            const int top = static_cast<int>(random() % maximum_top);
+            const int offset = static_cast<int>(random() % 120);
+            const double guess = offset + static_cast<int>(random() % 41) - 20.0;  // As imprecise as a scroll bar.
+            samples.push_back({
+                Frame(page(cv::Rect({0, top}, area_size)).clone()),
+                Frame(page(cv::Rect({0, top + offset}, area_size)).clone()),
+                guess,
+                offset,
+            });
+        }
+        return samples;
+    }
+
+    const chara_detail::scraper_config::SceneScraperConfig config;
+    const std::vector<std::filesystem::path> dump_paths;
+    const size_t pairs;
+};
+
+}  // namespace uma::tool
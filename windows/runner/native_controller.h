@@ -58,8 +58,8 @@ public:
 
         app::NativeApi::instance().setNotifyCallback([this](const auto &message) { channel->notify(message); });
 
-        connection->listen([](const auto &frame, const auto &size, const auto &ts) {
-            app::NativeApi::instance().updateFrame(frame, size, ts);
+        connection->listen([](const auto &frame, const auto &scaled_size, const auto &ts) {
+            app::NativeApi::instance().updateFrame(frame, BGRA8888, scaled_size, frame.size(), ts);
         });
     }
 
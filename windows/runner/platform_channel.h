@@ -7,6 +7,7 @@
 #include <flutter/standard_method_codec.h>
 
 #include "util/event_util.h"
+#include "util/json_util.h"
 
 namespace uma::windows {
 
@@ -38,8 +39,15 @@ public:
                 }
             });
 
+        // Progress notifications can outpace the UI thread. Only the latest one for each scroll area is delivered.
         const auto notify_connection =
-            event_util::makeQueuedConnection<std::string>(event_util::QueueLimitMode::NoLimit);
+            event_util::makeCoalescingConnection<std::string>([](const std::string &message) -> std::optional<int> {
+                const auto json = json_util::Json::parse(message);
+                if (json["type"] == "onScrollUpdated") {
+                    return json["index"].get<int>();
+                }
+                return std::nullopt;
+            });
         on_notify = notify_connection;
         message_processor = notify_connection;
         notify_connection->listen([this](const std::string &message) {
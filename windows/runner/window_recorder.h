@@ -7,6 +7,7 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "cv/frame_pool.h"
 #include "types/shape.h"
 #include "util/event_util.h"
 #include "util/json_util.h"
@@ -109,23 +110,31 @@ public:
             return {};
         }
 
-        if (plain_mat.size() != rect.size()) {
-            plain_mat = cv::Mat(rect.size(), CV_8UC4);
-        }
+        // The frame keeps the captured image until it is converted on another thread, so it is never reused here.
+        // It returns to the pool once the frame is dropped.
+        plain_mat = FramePool::instance().lease(rect.size(), CV_8UC4);
 
         const Size<int> &circumscribe_size =
             window_profile.fixed_aspect_ratio ? minimum_size : getCircumscribedSize(rect.size(), minimum_size);
-        const Size<int> &scaled_size =
-            force_resize ? circumscribe_size : getRatioFixedSize(rect.size(), circumscribe_size);
-        if (scaled_size != scaled_mat.size()) {
-            scaled_mat = cv::Mat(scaled_size.toCVSize(), CV_8UC4);
-        }
+        scaled_size = force_resize ? circumscribe_size : getRatioFixedSize(rect.size(), circumscribe_size);
 
         return capture(GetDesktopWindow(), rect);
     }
 
     [[nodiscard]] cv::Size lastSize() const { return plain_mat.size(); }
 
+    // The size of the frame the captured image is presented as.
+    [[nodiscard]] cv::Size lastScaledSize() const { return scaled_size.toCVSize(); }
+
+    // Resizes and converts a captured image as the frame would be.
+    [[nodiscard]] cv::Mat toScaledBGR(const cv::Mat &raw) const {
+        cv::Mat scaled_mat;
+        cv::resize(raw, scaled_mat, scaled_size.toCVSize(), 0, 0, cv::INTER_LINEAR);
+        cv::Mat image;
+        cv::cvtColor(scaled_mat, image, cv::COLOR_BGRA2BGR);
+        return image;
+    }
+
 private:
     cv::Mat capture(HWND window, const cv::Rect &rect) const {
         /**
@@ -164,17 +173,12 @@ private:
             reinterpret_cast<BITMAPINFO *>(&bitmap_header),
             DIB_RGB_COLORS);
 
-        cv::resize(plain_mat, scaled_mat, scaled_mat.size(), cv::INTER_LINEAR);
-
-        cv::Mat image = cv::Mat(scaled_mat.size(), CV_8UC3);
-        cv::cvtColor(scaled_mat, image, cv::COLOR_BGRA2BGR);
-
         SelectObject(memory_dc, old_bitmap);
         DeleteObject(bitmap);
         DeleteObject(memory_dc);
         ReleaseDC(window, window_dc);
 
-        return image;
+        return plain_mat;
     }
 
     const windows_config::WindowProfile window_profile;
@@ -182,7 +186,7 @@ private:
     const bool force_resize;
 
     cv::Mat plain_mat;
-    cv::Mat scaled_mat;
+    Size<int> scaled_size = {0, 0};
 };
 
 constexpr int64 nano_scale = std::nano::den / std::nano::num;
@@ -248,7 +252,7 @@ public:
                 return "Failed to take screenshot. Window found, but failed to capture.";
             }
         }
-        cv::imwrite(path.string(), image);
+        cv::imwrite(path.string(), capturer->toScaledBGR(image));
         return {};
     }
 
@@ -261,7 +265,7 @@ protected:
             time_keeper.waitLap();
             const auto &frame = capturer->capture();
             if (!frame.empty()) {
-                sender->send(frame, capturer->lastSize(), chrono_util::timestamp());
+                sender->send(frame, capturer->lastScaledSize(), chrono_util::timestamp());
             }
         }
 